@@ -209,57 +209,143 @@ uint16_t tft_color565(uint16_t r, uint16_t g, uint16_t b)
 #define TRIANG_WIDTH    8
 
 int16_t triang_x_min, triang_x_max;
+uint32_t scale_fsamp = 0;    // I Q sample freq of the drawn scale  (fsamp_ch changes with the ADC channel plan)
+uint16_t scale_zoom = 1;     // zoom FFT of the drawn scale
+int32_t scale_center = 0;    // Hz, scale center from the tuned freq
+int32_t scale_rit = 0;       // Hz, RX freq from the tuned freq
+uint32_t scale_freq_hz = 0;  // Hz on column 0
+uint32_t scale_span_hz = 1;  // Hz on all columns
+uint16_t wf_head_line = 0;   // newest waterfall line drawn
 
 /*********************************************************
-  
+  waterfall center from the tuned freq:  zoom = tuned freq + zoom offset,  no zoom = Si5351 freq (fine tuning by the DSP)
 *********************************************************/
-void display_fft_graf_top(void) 
+static int32_t scale_center_offset(void)
 {
-  int16_t siz, j, x;  //i, y
-  uint32_t freq_graf_ini;
-  uint32_t freq_graf_fim;
+  return((fft_zoom > 1) ? fft_zoom_offset : -dsp_tune_hz);
+}
+
+/*********************************************************
+  peak snap: freq of the next signal on the waterfall from freq_hz,  dir = +1 up  -1 down
+  signal = columns of the newest line >= SNAP_LEVEL, the freq of its peak column is returned,  0 = no signal
+*********************************************************/
+#define SNAP_LEVEL   96u    // waterfall level 0-255  (auto range: ~8dB over the noise floor)
+uint32_t display_peak_snap(uint32_t freq_hz, int16_t dir)
+{
+  const uint8_t *lvl = vet_graf_fft[wf_head_line];
+  int32_t x, xp;
+
+  x = (int32_t)(((int64_t)(int32_t)(freq_hz - scale_freq_hz) * GRAPH_NUM_COLS) / (int32_t)scale_span_hz);
+  //leave the signal under the cursor
+  while((x >= 0) && (x < (int32_t)GRAPH_NUM_COLS) && (lvl[x] >= SNAP_LEVEL))
+  {
+    x += dir;
+  }
+  //next signal
+  while((x >= 0) && (x < (int32_t)GRAPH_NUM_COLS) && (lvl[x] < SNAP_LEVEL))
+  {
+    x += dir;
+  }
+  if((x < 0) || (x >= (int32_t)GRAPH_NUM_COLS))
+  {
+    return(0);
+  }
+  //its peak
+  xp = x;
+  while((x >= 0) && (x < (int32_t)GRAPH_NUM_COLS) && (lvl[x] >= SNAP_LEVEL))
+  {
+    if(lvl[x] > lvl[xp])
+    {
+      xp = x;
+    }
+    x += dir;
+  }
+  //center of the column
+  return(scale_freq_hz + (uint32_t)((((uint64_t)(2*xp + 1)) * scale_span_hz) / (2u * GRAPH_NUM_COLS)));
+}
 
 
 
-    //graph min freq
-    freq_graf_ini = (hmi_freq - ((FFT_NSAMP/2)*FRES) )/1000;
+/*********************************************************
+  scale on top of the waterfall:  span = fsamp_ch / fft_zoom  around scale_center_offset()
+  marks each 10 x tick_hz, bigger each 50 x, freq (kHz) each 100 x
+*********************************************************/
+void display_fft_graf_top(void) 
+{
+  int16_t siz, j, x, xc;  //i, y
+  uint32_t freq_graf_ini;
+  uint32_t freq_graf_fim;
+  uint32_t freq_graf_hz;
+  uint32_t span_hz, tick_hz, tick;
+  static const uint16_t zoom_tick_hz[5] = { 1000, 500, 200, 100, 50 };   // zoom 1 2 4 8 16
+
+
+    scale_fsamp = fsamp_ch;
+    scale_zoom = fft_zoom;
+    scale_center = scale_center_offset();
+    scale_rit = rit_hz;
+    span_hz = scale_fsamp / scale_zoom;
+    for(j=0; (j<4) && ((1u << j) < scale_zoom); j++) { }
+    tick_hz = zoom_tick_hz[j];
+
+    //graph min freq  (Hz on column 0)
+    freq_graf_hz = hmi_freq + scale_center - (span_hz/2);
+    scale_freq_hz = freq_graf_hz;
+    scale_span_hz = span_hz;
+    freq_graf_ini = (freq_graf_hz + tick_hz - 1)/tick_hz;    //first tick
   
     //graph max freq
-    freq_graf_fim = (hmi_freq + ((FFT_NSAMP/2)*FRES) )/1000;
+    freq_graf_fim = (freq_graf_hz + span_hz)/tick_hz;
+
+    //RX freq column = tuned freq + RIT  (fine tuning and zoom offset move it from the center)
+    xc = (int16_t)(GRAPH_NUM_COLS/2) + (int16_t)(((scale_rit - scale_center) * (int32_t)GRAPH_NUM_COLS) / (int32_t)span_hz);
+    if(xc < TRIANG_WIDTH)
+    {
+      xc = TRIANG_WIDTH;
+    }
+    else if(xc > (display_WIDTH - 1 - TRIANG_WIDTH))
+    {
+      xc = display_WIDTH - 1 - TRIANG_WIDTH;
+    }
 
    
-    //little triangle indicating the center freq
-    switch(dsp_getmode())  //{"USB","LSB","AM","CW"}
+    //little triangle indicating the tuned freq  (erase the old one, it moves with the fine tuning)
+    tft.fillRect(0, Y_MIN_DRAW - TRIANG_TOP, display_WIDTH, TRIANG_TOP - ABOVE_SCALE + 1, TFT_BLACK);
+    switch(dsp_getmode())  //{"USB","LSB","AM","CW","SAM","SAM-U","SAM-L","FM"}
     {
       case 0:  //USB
-        triang_x_min = (display_WIDTH/2);
-        triang_x_max = (display_WIDTH/2)+TRIANG_WIDTH;
-        tft.fillTriangle(display_WIDTH/2, Y_MIN_DRAW - ABOVE_SCALE, display_WIDTH/2, Y_MIN_DRAW - TRIANG_TOP, (display_WIDTH/2)+TRIANG_WIDTH, Y_MIN_DRAW - ABOVE_SCALE, TFT_YELLOW);
-        tft.fillTriangle((display_WIDTH/2)-1, Y_MIN_DRAW - ABOVE_SCALE, display_WIDTH/2, Y_MIN_DRAW - TRIANG_TOP, (display_WIDTH/2)-TRIANG_WIDTH, Y_MIN_DRAW - ABOVE_SCALE, TFT_BLACK);
+      case 5:  //SAM-U
+        triang_x_min = xc;
+        triang_x_max = xc+TRIANG_WIDTH;
+        tft.fillTriangle(xc, Y_MIN_DRAW - ABOVE_SCALE, xc, Y_MIN_DRAW - TRIANG_TOP, xc+TRIANG_WIDTH, Y_MIN_DRAW - ABOVE_SCALE, TFT_YELLOW);
+        tft.fillTriangle(xc-1, Y_MIN_DRAW - ABOVE_SCALE, xc, Y_MIN_DRAW - TRIANG_TOP, xc-TRIANG_WIDTH, Y_MIN_DRAW - ABOVE_SCALE, TFT_BLACK);
         break;
       case 1:  //LSB
-        triang_x_min = (display_WIDTH/2)-TRIANG_WIDTH;
-        triang_x_max = (display_WIDTH/2);
-        tft.fillTriangle(display_WIDTH/2, Y_MIN_DRAW - ABOVE_SCALE, 
-                         display_WIDTH/2, Y_MIN_DRAW - TRIANG_TOP, (display_WIDTH/2)-TRIANG_WIDTH, Y_MIN_DRAW - ABOVE_SCALE, 
+      case 6:  //SAM-L
+        triang_x_min = xc-TRIANG_WIDTH;
+        triang_x_max = xc;
+        tft.fillTriangle(xc, Y_MIN_DRAW - ABOVE_SCALE, 
+                         xc, Y_MIN_DRAW - TRIANG_TOP, xc-TRIANG_WIDTH, Y_MIN_DRAW - ABOVE_SCALE, 
                          TFT_YELLOW);
-        tft.fillTriangle((display_WIDTH/2)+1, Y_MIN_DRAW - ABOVE_SCALE, 
-                          display_WIDTH/2, Y_MIN_DRAW - TRIANG_TOP, (display_WIDTH/2)+TRIANG_WIDTH, Y_MIN_DRAW - ABOVE_SCALE, 
+        tft.fillTriangle(xc+1, Y_MIN_DRAW - ABOVE_SCALE, 
+                          xc, Y_MIN_DRAW - TRIANG_TOP, xc+TRIANG_WIDTH, Y_MIN_DRAW - ABOVE_SCALE, 
                           TFT_BLACK);
         break;
       case 2:  //AM
-        triang_x_min = (display_WIDTH/2)-TRIANG_WIDTH;
-        triang_x_max = (display_WIDTH/2)+TRIANG_WIDTH;
-        tft.fillTriangle((display_WIDTH/2)-TRIANG_WIDTH, Y_MIN_DRAW - ABOVE_SCALE, display_WIDTH/2, Y_MIN_DRAW - TRIANG_TOP, (display_WIDTH/2)+TRIANG_WIDTH, Y_MIN_DRAW - ABOVE_SCALE, TFT_YELLOW);
+      case 4:  //SAM
+      case 7:  //FM
+        triang_x_min = xc-TRIANG_WIDTH;
+        triang_x_max = xc+TRIANG_WIDTH;
+        tft.fillTriangle(xc-TRIANG_WIDTH, Y_MIN_DRAW - ABOVE_SCALE, xc, Y_MIN_DRAW - TRIANG_TOP, xc+TRIANG_WIDTH, Y_MIN_DRAW - ABOVE_SCALE, TFT_YELLOW);
         break;
       case 3:  //CW = LSB
-        triang_x_min = (display_WIDTH/2)-(TRIANG_WIDTH*2/4);
-        triang_x_max = (display_WIDTH/2);   //-(TRIANG_WIDTH*1/4);
-        tft.fillTriangle(display_WIDTH/2, Y_MIN_DRAW - ABOVE_SCALE, 
-                         display_WIDTH/2, Y_MIN_DRAW - TRIANG_TOP, (display_WIDTH/2)-TRIANG_WIDTH, Y_MIN_DRAW - ABOVE_SCALE, 
+        triang_x_min = xc-(TRIANG_WIDTH*2/4);
+        triang_x_max = xc;   //-(TRIANG_WIDTH*1/4);
+        tft.fillTriangle(xc, Y_MIN_DRAW - ABOVE_SCALE, 
+                         xc, Y_MIN_DRAW - TRIANG_TOP, xc-TRIANG_WIDTH, Y_MIN_DRAW - ABOVE_SCALE, 
                          TFT_YELLOW);
-        tft.fillTriangle((display_WIDTH/2)+1, Y_MIN_DRAW - ABOVE_SCALE, 
-                          display_WIDTH/2, Y_MIN_DRAW - TRIANG_TOP, (display_WIDTH/2)+TRIANG_WIDTH, Y_MIN_DRAW - ABOVE_SCALE, 
+        tft.fillTriangle(xc+1, Y_MIN_DRAW - ABOVE_SCALE, 
+                          xc, Y_MIN_DRAW - TRIANG_TOP, xc+TRIANG_WIDTH, Y_MIN_DRAW - ABOVE_SCALE, 
                           TFT_BLACK);
         break;
     }
@@ -272,26 +358,32 @@ void display_fft_graf_top(void)
     tft.fillRect(0, Y_MIN_DRAW - 10, display_WIDTH, 10, TFT_BLACK);
     tft.fillRect(triang_x_min, Y_MIN_DRAW - 10, (triang_x_max - triang_x_min + 1), 11, tft.color565(25, 25, 25)); //shadow
     
-    x=0;
-    for(; freq_graf_ini < freq_graf_fim; freq_graf_ini+=1)
+    for(tick = freq_graf_ini; tick <= freq_graf_fim; tick++)
     {
-      if((freq_graf_ini % 10) == 0)
+      x = (int16_t)(((tick*tick_hz) - freq_graf_hz) * GRAPH_NUM_COLS / span_hz);   //column of this tick
+      if(x >= (int16_t)GRAPH_NUM_COLS)
+      {
+        break;
+      }
+
+      if((tick % 10) == 0)
       {
         tft.drawFastVLine (x, Y_MIN_DRAW - 11, 5, TFT_WHITE);
       }
-      if((freq_graf_ini % 50) == 0)
+      if((tick % 50) == 0)
       {
         tft.drawFastVLine (x-1, Y_MIN_DRAW - 11, 7, TFT_WHITE);
         tft.drawFastVLine (x, Y_MIN_DRAW - 11, 7, TFT_WHITE);
         tft.drawFastVLine (x+1, Y_MIN_DRAW - 11, 7, TFT_WHITE);
       }
-      if((freq_graf_ini % 100) == 0)
+      if((tick % 100) == 0)
       {
          tft.drawFastVLine (x-1, Y_MIN_DRAW - 11, 10, TFT_WHITE);
          tft.drawFastVLine (x, Y_MIN_DRAW - 11, 10, TFT_WHITE);
          tft.drawFastVLine (x+1, Y_MIN_DRAW - 11, 10, TFT_WHITE);
     
          //write new freq values  on top of scale
+         freq_graf_ini = (tick*tick_hz)/1000;   //kHz
          sprintf(vet_char, "%lu", freq_graf_ini);
          siz = strlen(vet_char);
          if(x < (2*X_CHAR1))   //to much to left
@@ -309,7 +401,6 @@ void display_fft_graf_top(void)
             tft_writexy_plus(1, TFT_MAGENTA, TFT_BLACK,0,j,7,0,(uint8_t *)vet_char);  
          }
       }
-      x+=2;
     }
   
 
@@ -321,64 +412,286 @@ void display_fft_graf_top(void)
 
 
 
-uint8_t vet_graf_fft[GRAPH_NUM_LINES][FFT_NSAMP];    // [NL][NCOL]
-//uint16_t vet_graf_fft_pos = 0;
+uint8_t vet_graf_fft[GRAPH_RING_LINES][GRAPH_NUM_COLS];    // [NL][NCOL]   circular buffer of waterfall lines
+volatile uint16_t vet_graf_fft_pos = 0;   // head = newest line, moved by core1 when the display took the last one
+uint16_t wf_palette[256];   // RGB565 color for each waterfall intensity level
+
+/*********************************************************
+  build the waterfall color palette
+*********************************************************/
+void display_wf_palette(uint16_t pal)
+{
+  uint16_t i;
+
+  for(i=0; i<256; i++)
+  {
+    if(pal == WF_PALETTE_HEAT)
+    {
+      if(i < 64)
+      {
+        wf_palette[i] = tft.color565(0, 0, i*4);                      //black to blue
+      }
+      else if(i < 128)
+      {
+        wf_palette[i] = tft.color565(0, (i-64)*4, 255);               //blue to cyan
+      }
+      else if(i < 192)
+      {
+        wf_palette[i] = tft.color565((i-128)*4, 255, 255-((i-128)*4));  //cyan to yellow
+      }
+      else
+      {
+        wf_palette[i] = tft.color565(255, 255-((i-192)*4), 0);        //yellow to red
+      }
+    }
+    else  //WF_PALETTE_GRAY
+    {
+      wf_palette[i] = tft.color565(i, i, i);
+    }
+  }
+}
+
+
+#if WATERFALL_DRAW != WF_DRAW_PIXEL
+#define WF_DRAW_COLS   ((GRAPH_NUM_COLS < display_WIDTH) ? GRAPH_NUM_COLS : display_WIDTH)
+uint16_t wf_line_buf[GRAPH_NUM_COLS];   // one waterfall line in RGB565, sent to display in one burst
+
+/*********************************************************
+  convert one line of the ring buffer to RGB565 colors
+*********************************************************/
+void display_fft_line_buf(uint16_t line)
+{
+  uint16_t x;
+  uint16_t extra_color;
+
+  extra_color = tft.color565(25, 25, 25);  //light shadow on center freq
+
+  for(x=0; x<WF_DRAW_COLS; x++)
+  {
+    wf_line_buf[x] = wf_palette[vet_graf_fft[line][x]];
+  }
+  for(x=triang_x_min; (x<=triang_x_max) && (x<WF_DRAW_COLS); x++)  //tune shadow area
+  {
+    wf_line_buf[x] |= extra_color;
+  }
+}
+
+
+/*********************************************************
+  send one line as one SPI burst
+*********************************************************/
+void display_fft_line_push(uint16_t y)
+{
+  tft.startWrite();
+  tft.setAddrWindow(0, y, WF_DRAW_COLS, 1);
+  tft.pushColors(wf_line_buf, WF_DRAW_COLS, true);   //swap bytes, display wants MSB first
+  tft.endWrite();
+}
+#endif
+
+
+#if WATERFALL_DRAW == WF_DRAW_HW_SCROLL
+// ILI9341 vertical scroll area = visible waterfall lines,  top fixed area = everything above
+#define WF_SCROLL_TFA   (Y_MIN_WF + 1)
+#define WF_SCROLL_VSA   (display_HEIGHT - WF_SCROLL_TFA)
+#define ILI9341_VSCRDEF   0x33
+#define ILI9341_VSCRSADD  0x37
+uint16_t wf_scroll_pos = 0;   // scroll area line (0 to VSA-1) shown on top of the waterfall
+
+/*********************************************************
+  define the vertical scroll area for the waterfall
+*********************************************************/
+void display_fft_scroll_setup(void)
+{
+  uint16_t bfa = TFT_HEIGHT - WF_SCROLL_TFA - WF_SCROLL_VSA;
+
+  tft.writecommand(ILI9341_VSCRDEF);
+  tft.writedata(WF_SCROLL_TFA >> 8);
+  tft.writedata(WF_SCROLL_TFA & 0xff);
+  tft.writedata(WF_SCROLL_VSA >> 8);
+  tft.writedata(WF_SCROLL_VSA & 0xff);
+  tft.writedata(bfa >> 8);
+  tft.writedata(bfa & 0xff);
+
+  wf_scroll_pos = 0;
+  tft.writecommand(ILI9341_VSCRSADD);
+  tft.writedata(WF_SCROLL_TFA >> 8);
+  tft.writedata(WF_SCROLL_TFA & 0xff);
+}
+#endif
+
+
+#if PAN_NUM_LINES > 0
+#define PAN_DRAW_COLS   ((GRAPH_NUM_COLS < display_WIDTH) ? GRAPH_NUM_COLS : display_WIDTH)
+uint8_t pan_trace[2][PAN_NUM_TRACE][GRAPH_NUM_COLS];    // written by core1
+volatile uint16_t pan_trace_front = 0;
+volatile uint16_t pan_trace_new = 0;
+uint8_t pan_y_avg[GRAPH_NUM_COLS];     // trace line of each column, 0 = top of the panadapter
+uint8_t pan_y_peak[GRAPH_NUM_COLS];
+uint16_t pan_line_buf[GRAPH_NUM_COLS];
+
+/*********************************************************
+  panadapter between the scale and the waterfall
+  averaged spectrum filled under the trace, peak hold as dots above it
+  each line sent as one burst (no erase of the area = no flicker)
+*********************************************************/
+void display_pan_graf(void)
+{
+  uint16_t x, y, c;
+  uint16_t front = pan_trace_front;
+  uint16_t col_fill, col_trace, col_peak, shadow;
+
+  //take the snapshot,  core1 can swap the buffers again after pan_trace_new = 0
+  for(x=0; x<PAN_DRAW_COLS; x++)
+  {
+    pan_y_avg[x] = (PAN_NUM_LINES-1) - ((pan_trace[front][PAN_TRACE_AVG][x] * PAN_NUM_LINES) >> 8);
+    pan_y_peak[x] = (PAN_NUM_LINES-1) - ((pan_trace[front][PAN_TRACE_PEAK][x] * PAN_NUM_LINES) >> 8);
+  }
+  pan_trace_new = 0;
+
+  col_fill = tft.color565(0, 70, 0);
+  col_trace = TFT_GREEN;
+  col_peak = TFT_YELLOW;
+  shadow = tft.color565(25, 25, 25);  //light shadow on center freq
+
+  for(y=0; y<PAN_NUM_LINES; y++)
+  {
+    for(x=0; x<PAN_DRAW_COLS; x++)
+    {
+      if(y == pan_y_avg[x])
+      {
+        c = col_trace;
+      }
+      else if(y > pan_y_avg[x])
+      {
+        c = col_fill;
+      }
+      else if(y == pan_y_peak[x])
+      {
+        c = col_peak;
+      }
+      else
+      {
+        c = TFT_BLACK;
+      }
+      if((x>=triang_x_min) && (x<=triang_x_max))  //tune shadow area
+      {
+        c |= shadow;
+      }
+      pan_line_buf[x] = c;
+    }
+    tft.startWrite();
+    tft.setAddrWindow(0, Y_MIN_DRAW + 1 + y, PAN_DRAW_COLS, 1);
+    tft.pushColors(pan_line_buf, PAN_DRAW_COLS, true);   //swap bytes, display wants MSB first
+    tft.endWrite();
+  }
+}
+#endif
+
+
 /*********************************************************
   
 *********************************************************/
 void display_fft_graf(void) 
 {
-  uint16_t x, y;
+  uint16_t line, head;
+
+  //take the newest line:  core1 starts a new line on the next FFT (before, it adds the FFTs to this one)
+  head = vet_graf_fft_pos;
+  wf_head_line = head;
+  fft_display_graf_new = 0;
+
+  if((scale_fsamp != fsamp_ch) || (scale_zoom != fft_zoom) ||
+     (scale_center != scale_center_offset()) || (scale_rit != rit_hz))   //ADC channel plan changed (VOX on/off):  +-80kHz <-> +-120kHz,  new zoom, fine tuning or RIT
+  {
+    display_fft_graf_top();
+  }
+
+#if WATERFALL_DRAW == WF_DRAW_PIXEL || WATERFALL_DRAW == WF_DRAW_LINE
+  uint16_t y, age;
+#endif
+#if WATERFALL_DRAW == WF_DRAW_PIXEL
+  uint16_t x;
   uint16_t extra_color;
 
 
 
   //erase waterfall area
-  //tft.fillRect(0, Y_MIN_DRAW, GRAPH_NUM_COLS, GRAPH_NUM_LINES, TFT_BLACK);
+  //tft.fillRect(0, Y_MIN_WF, GRAPH_NUM_COLS, WF_NUM_LINES, TFT_BLACK);
 
   extra_color = tft.color565(25, 25, 25);  //light shadow on center freq
 
   //plot waterfall
-  //vet_graf_fft[GRAPH_NUM_LINES][GRAPH_NUM_COLS]   [NL][NCOL]
-  for(y=0; y<GRAPH_NUM_LINES; y++)
+  //vet_graf_fft[GRAPH_RING_LINES][GRAPH_NUM_COLS]   [NL][NCOL]
+  //walk the ring from the head (newest line on top) back to the oldest line (bottom)
+  line = head;
+  for(age=0; age<WF_NUM_LINES; age++)
   {
+    y = Y_MIN_WF + 1 + age;
+
     //erase one waterfall line
-    tft.drawFastHLine (0, (GRAPH_NUM_LINES + Y_MIN_DRAW - y), GRAPH_NUM_COLS, TFT_BLACK);
+    tft.drawFastHLine (0, y, GRAPH_NUM_COLS, TFT_BLACK);
 
     for(x=0; x<GRAPH_NUM_COLS; x++)
     {
       //plot one waterfall line
-      if(vet_graf_fft[y][x] > 0)
+      if(vet_graf_fft[line][x] > 0)
       {
         if((x>=triang_x_min) && (x<=triang_x_max))  //tune shadow area
         {
-          tft.drawPixel(x, (GRAPH_NUM_LINES + Y_MIN_DRAW - y), TFT_WHITE|extra_color); 
+          tft.drawPixel(x, y, wf_palette[vet_graf_fft[line][x]]|extra_color); 
         }
         else
         {
-          tft.drawPixel(x, (GRAPH_NUM_LINES + Y_MIN_DRAW - y), TFT_WHITE); 
+          tft.drawPixel(x, y, wf_palette[vet_graf_fft[line][x]]); 
         }
       }
       else
       {
         if((x>=triang_x_min) && (x<=triang_x_max))  //tune shadow area
         {
-          tft.drawPixel(x, (GRAPH_NUM_LINES + Y_MIN_DRAW - y), TFT_BLACK|extra_color); 
+          tft.drawPixel(x, y, TFT_BLACK|extra_color); 
         }
       }
     }
+
+    line = (line == 0) ? (GRAPH_RING_LINES-1) : (line-1);
   }
 
+#elif WATERFALL_DRAW == WF_DRAW_LINE
 
-  //move graph data one line up to open space for next FFT (= last line)
-  for(y=0; y<(GRAPH_NUM_LINES-1); y++)
+  //plot waterfall, one burst per line
+  //walk the ring from the head (newest line on top) back to the oldest line (bottom)
+  line = head;
+  for(age=0; age<WF_NUM_LINES; age++)
   {
-    for(x=0; x<GRAPH_NUM_COLS; x++)
+    y = Y_MIN_WF + 1 + age;
+    if(y >= display_HEIGHT)
     {
-      vet_graf_fft[y][x] = vet_graf_fft[y+1][x];
+      break;    //last line is out of the screen
     }
+
+    display_fft_line_buf(line);
+    display_fft_line_push(y);
+
+    line = (line == 0) ? (GRAPH_RING_LINES-1) : (line-1);
   }
 
+#else  //WF_DRAW_HW_SCROLL
+
+  //scroll one line down and write only the new line on top
+  wf_scroll_pos = (wf_scroll_pos == 0) ? (WF_SCROLL_VSA-1) : (wf_scroll_pos-1);
+
+  line = head;
+  display_fft_line_buf(line);
+  display_fft_line_push(WF_SCROLL_TFA + wf_scroll_pos);
+
+  tft.writecommand(ILI9341_VSCRSADD);
+  tft.writedata((WF_SCROLL_TFA + wf_scroll_pos) >> 8);
+  tft.writedata((WF_SCROLL_TFA + wf_scroll_pos) & 0xff);
+
+#endif
+
 
  
 }
@@ -538,6 +851,11 @@ char s[32];
 
   tft.fillScreen(TFT_BLACK);
   
+  display_wf_palette(WF_PALETTE_HEAT);
+
+#if WATERFALL_DRAW == WF_DRAW_HW_SCROLL
+  display_fft_scroll_setup();
+#endif
 
   //tft.drawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
   //tft.drawRect(X_MIN_AUD_GRAPH-1, Y_MIN_AUD_GRAPH-1, AUD_GRAPH_NUM_COLS+2, (AUD_GRAPH_MAX - AUD_GRAPH_MIN + 1)+2, TFT_WHITE);
@@ -95,13 +95,56 @@ uint16_t yellow = tft.color565(255, 255, 0);
 
 
 // waterfall = FFT graph
-#define GRAPH_NUM_LINES   (48u)
-#define GRAPH_NUM_COLS    (FFT_NSAMP)
+#define GRAPH_NUM_LINES   (48u)     //whole graph area under the scale = panadapter + waterfall
+#define PAN_NUM_LINES     (16u)     //panadapter trace on top of the graph area  (0 = waterfall only)
+#define WF_NUM_LINES      (GRAPH_NUM_LINES - PAN_NUM_LINES)
+//FFT bins resampled to the display width  (display_WIDTH is known only after TFT_eSPI.h, dsp.cpp needs the number)
+#if ROTATION_SETUP == 0 || ROTATION_SETUP == 2
+#define GRAPH_NUM_COLS    (240u)
+#else
+#define GRAPH_NUM_COLS    (320u)
+#endif
 #define Y_MIN_DRAW   (display_HEIGHT - GRAPH_NUM_LINES)
+#define Y_MIN_WF     (Y_MIN_DRAW + PAN_NUM_LINES)
+
+
+#define  WF_DRAW_PIXEL       11
+#define  WF_DRAW_LINE        22
+#define  WF_DRAW_HW_SCROLL   33
+// choose how the waterfall is drawn
+// WF_DRAW_PIXEL     = all lines redrawn pixel by pixel with drawPixel (original, slow)
+// WF_DRAW_LINE      = all lines redrawn, each line sent as one RGB565 burst
+// WF_DRAW_HW_SCROLL = ILI9341 vertical scroll area, only the new line is sent  (ROTATION_SETUP 0 only, in landscape the ILI9341 scrolls horizontally)
+//#define WATERFALL_DRAW  WF_DRAW_PIXEL
+#define WATERFALL_DRAW  WF_DRAW_LINE
+//#define WATERFALL_DRAW  WF_DRAW_HW_SCROLL
+
+// waterfall color palette, index = intensity level 0 to 255 from FFT
+#define WF_PALETTE_GRAY   0
+#define WF_PALETTE_HEAT   1   //black blue cyan yellow red
+#define WF_PALETTE_NUM    2
+extern uint16_t wf_palette[256];
+void display_wf_palette(uint16_t pal);
+
+#if WATERFALL_DRAW == WF_DRAW_HW_SCROLL && ROTATION_SETUP != 0
+#error "WF_DRAW_HW_SCROLL needs ROTATION_SETUP 0: the ILI9341 vertical scroll runs along the 320 pixels side"
+#endif
 
 
-extern uint8_t vet_graf_fft[GRAPH_NUM_LINES][GRAPH_NUM_COLS];    // [NL][NCOL]
-//extern uint16_t vet_graf_fft_pos;
+#define GRAPH_RING_LINES  (WF_NUM_LINES+1u)   // +1 = line written by core1 while the display draws the others
+extern uint8_t vet_graf_fft[GRAPH_RING_LINES][GRAPH_NUM_COLS];    // [NL][NCOL]
+extern volatile uint16_t vet_graf_fft_pos;   // head of the circular buffer = newest line
+
+#if PAN_NUM_LINES > 0
+// panadapter traces, levels 0 to 255 as the waterfall, double buffer: core1 writes the back one, display reads the front one
+#define PAN_TRACE_AVG    0    //averaged spectrum
+#define PAN_TRACE_PEAK   1    //peak hold
+#define PAN_NUM_TRACE    2
+extern uint8_t pan_trace[2][PAN_NUM_TRACE][GRAPH_NUM_COLS];    // [buffer][trace][NCOL]
+extern volatile uint16_t pan_trace_front;   // buffer of the display
+extern volatile uint16_t pan_trace_new;     // front buffer not drawn yet, core1 swaps the buffers only when 0
+void display_pan_graf(void);
+#endif
 
 
 
@@ -118,6 +161,7 @@ uint16_t tft_color565(uint16_t r, uint16_t g, uint16_t b);
 
 void display_fft_graf(void);
 void display_fft_graf_top(void);
+uint32_t display_peak_snap(uint32_t freq_hz, int16_t dir);
 void display_tft_setup0(void);
 void display_tft_setup(void);
 void display_tft_loop(void);
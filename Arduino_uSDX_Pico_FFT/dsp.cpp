@@ -34,12 +34,14 @@
 #include "adc.h"
 #include "irq.h"
 #include "hardware/dma.h"
+#include "hardware/sync.h"
 #include "pico/multicore.h"
 #include "hmi.h"
 #include "hardware/structs/bus_ctrl.h"
 #include "uSDR.h"
 #include "dsp.h"
 #include "display_tft.h"
+#include "nco.h"
 #include "kiss_fftr.h"
 #include "TFT_eSPI.h"
 #include "display_tft.h"
@@ -57,7 +59,10 @@
 #define ADC0_IRQ_FIFO 		22		// FIFO IRQ number
 #define GP_PTT				    15		// PTT pin 20 (GPIO 15)
 
-int dma_chan;
+int dma_chan[2];          // two ADC DMA channels chained to each other, capture never stops
+uint16_t dma_chan_irq = 0;  // channel expected to finish next  (they alternate)
+volatile uint32_t dma_late_count = 0;      // dma_handler late: both channels finished, capture started again (samples lost)
+volatile uint32_t adc_overflow_count = 0;  // ADC FIFO overflow = samples lost (gap)
 
 volatile uint16_t tim_count = 0;
 volatile uint16_t tim_count_loc = 0;
@@ -76,6 +81,174 @@ volatile bool tx_enabled; //, vox_active;
  **************************************************************************************/
 #define ABS(x)    ((x)<0?-(x):(x))
 #define MAG(i,q)  (ABS(i)>ABS(q) ? ABS(i)+((3*ABS(q))>>3) : ABS(q)+((3*ABS(i))>>3))
+// bin power in Q-3 = (i^2 + q^2) / 8:  max 2^28, the sum of 8 FFTs (linear average) fits on 32 bits
+#define SPEC_POW_SHIFT  3
+#define POW(i,q)  ((((uint32_t)((int32_t)(i)*(i))) + ((uint32_t)((int32_t)(q)*(q)))) >> SPEC_POW_SHIFT)
+
+
+
+
+/**************************************************************************************
+ * Waterfall intensity
+ * log2 of the FFT bin MAG in Q4 (1/16 of 6dB steps): msb position + fraction from LUT
+ * from the bin power:  log2(MAG) = log2(power) / 2
+ * level = (log2 - floor) * span_gain >> 8, clipped to 0..255  (index of the color palette)
+ * floor and span_gain are calculated by dsp_set_wf_range(), no division in the FFT loop
+ **************************************************************************************/
+#define LOG2_FRAC_BITS  5
+const uint8_t log2_frac_q4[1u<<LOG2_FRAC_BITS] =   // 16 * log2(1 + k/32)
+{
+  0, 1, 1, 2, 3, 3, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9,
+  9, 10, 10, 11, 11, 12, 12, 13, 13, 13, 14, 14, 15, 15, 15, 16
+};
+
+volatile int16_t wf_floor_q4;      // noise floor in log2 Q4
+volatile int16_t wf_span_gain;     // 255 * 256 / span in log2 Q4
+volatile bool wf_auto = true;      // floor and span follow the noise floor and the peak of the spectrum
+volatile int16_t fft_bfp_shift = 0;   // block floating point: left shift of the FFT input samples
+
+static inline uint16_t log2_q4(uint32_t m)
+{
+  uint16_t msb;
+
+  if(m == 0)
+  {
+    return 0;
+  }
+  msb = 31 - __builtin_clz(m);
+  if(msb >= LOG2_FRAC_BITS)
+  {
+    m >>= (msb - LOG2_FRAC_BITS);
+  }
+  else
+  {
+    m <<= (LOG2_FRAC_BITS - msb);
+  }
+  return (msb << 4) + log2_frac_q4[m & ((1u<<LOG2_FRAC_BITS)-1u)];
+}
+
+static inline uint8_t wf_level_log2(uint16_t l)
+{
+  int32_t lvl;
+
+  lvl = (((int32_t)l - wf_floor_q4) * wf_span_gain) >> 8;
+  if(lvl < 0)
+  {
+    return 0;
+  }
+  if(lvl > 255)
+  {
+    return 255;
+  }
+  return (uint8_t)lvl;
+}
+
+/* log2 Q4 of the bin MAG from the power in Q-SPEC_POW_SHIFT, FFT input shift removed = same scale for any fft_bfp_shift */
+static inline uint16_t pow_log2_q4(uint32_t p)
+{
+  int16_t l;
+
+  if(p == 0)
+  {
+    return 0;
+  }
+  l = ((log2_q4(p) + (SPEC_POW_SHIFT << 4)) >> 1) - (fft_bfp_shift << 4);
+  return (l < 0) ? 0 : (uint16_t)l;
+}
+
+static inline uint8_t wf_level_pow(uint32_t p)
+{
+  return wf_level_log2(pow_log2_q4(p));
+}
+
+/* floor and span in dB,  dB to log2 Q4 = dB * 16 / 6.02 = dB * 85 / 32 */
+void dsp_set_wf_range(uint16_t floor_db, uint16_t span_db)
+{
+  int32_t span_q4;
+
+  span_q4 = ((int32_t)span_db * 85) >> 5;
+  if(span_q4 < 16)
+  {
+    span_q4 = 16;   //min 6dB
+  }
+  wf_floor_q4 = ((int32_t)floor_db * 85) >> 5;
+  wf_span_gain = (255 * 256) / span_q4;
+  wf_auto = false;    // fixed range asked
+}
+
+
+
+/**************************************************************************************
+ * Waterfall auto range (display only, the audio gain is not touched)
+ * histogram of the bin levels of each averaged spectrum:
+ *   floor = level with WF_AUTO_FLOOR_PCT % of the bins below it, minus a small margin
+ *   span = peak - floor,  between WF_AUTO_SPAN_MIN and WF_AUTO_SPAN_MAX
+ * both follow slowly (1/4 of the error each spectrum)
+ **************************************************************************************/
+#define WF_HIST_SHIFT       3      // histogram bin = 8 log2 Q4 = 3dB
+#define WF_HIST_NUM         64     // 0 to 192dB
+#define WF_AUTO_FLOOR_PCT   25
+#define WF_AUTO_MARGIN_Q4   8      // 3dB under the noise
+#define WF_AUTO_SPAN_MIN    ((30 * 85) >> 5)   // 30dB in log2 Q4
+#define WF_AUTO_SPAN_MAX    ((90 * 85) >> 5)
+uint16_t wf_hist[WF_HIST_NUM];
+uint16_t wf_hist_peak;       // biggest bin level of the spectrum, log2 Q4
+int16_t wf_auto_floor_q4 = (WF_FLOOR_DB * 85) >> 5;
+int16_t wf_auto_span_q4 = (WF_SPAN_DB * 85) >> 5;
+
+void dsp_set_wf_auto(void)
+{
+  wf_auto = true;
+}
+
+/* log2 Q4 of one bin to the histogram */
+static inline void wf_hist_add(uint16_t l)
+{
+  uint16_t h = l >> WF_HIST_SHIFT;
+
+  wf_hist[(h < WF_HIST_NUM) ? h : (WF_HIST_NUM-1)]++;
+  if(l > wf_hist_peak)
+  {
+    wf_hist_peak = l;
+  }
+}
+
+/* new floor and span from the histogram of n bins, used on the next spectrum */
+static void wf_auto_range(uint16_t n)
+{
+  uint16_t h, cnt = 0, pct = (uint16_t)(((uint32_t)n * WF_AUTO_FLOOR_PCT) / 100u);
+  int16_t floor_q4, span_q4;
+
+  for(h=0; h<(WF_HIST_NUM-1); h++)
+  {
+    cnt += wf_hist[h];
+    if(cnt >= pct)
+    {
+      break;
+    }
+  }
+  floor_q4 = (int16_t)((h << WF_HIST_SHIFT) + (1u << (WF_HIST_SHIFT-1))) - WF_AUTO_MARGIN_Q4;
+  span_q4 = (int16_t)wf_hist_peak - floor_q4;
+  if(span_q4 < WF_AUTO_SPAN_MIN)
+  {
+    span_q4 = WF_AUTO_SPAN_MIN;
+  }
+  else if(span_q4 > WF_AUTO_SPAN_MAX)
+  {
+    span_q4 = WF_AUTO_SPAN_MAX;
+  }
+
+  wf_auto_floor_q4 += (floor_q4 - wf_auto_floor_q4) / 4;
+  wf_auto_span_q4 += (span_q4 - wf_auto_span_q4) / 4;
+  if(wf_auto)
+  {
+    wf_floor_q4 = wf_auto_floor_q4;
+    wf_span_gain = (255 * 256) / wf_auto_span_q4;
+  }
+
+  memset(wf_hist, 0, sizeof(wf_hist));
+  wf_hist_peak = 0;
+}
 
 
 
@@ -841,6 +1014,48 @@ static int16_t am_lpf_taps[AM_LPF_TAP_NUM] = {
 
 
 
+/*
+
+NBFM filter, windowed sinc (Kaiser beta 5) designed for the I Q of the discriminator
+(+-2.5kHz deviation + 3kHz audio, limited by the 16kHz decimator)
+
+sampling frequency: 16000 Hz
+
+fixed point precision: 16 bits, same DC gain as the AM filter
+
+* 0 Hz - 4500 Hz
+  gain = 1   (-0.1dB @4000Hz)
+
+* 5000 Hz = -3.7dB    6000 Hz = -19dB    7000 Hz - 8000 Hz = -57dB
+
+*/
+
+#define FM_LPF_TAP_NUM 19
+
+static int16_t fm_lpf_taps[FM_LPF_TAP_NUM] = {
+  -10,
+  -76,
+  230,
+  -89,
+  -614,
+  1215,
+  -212,
+  -3106,
+  7165,
+  17219,
+  7165,
+  -3106,
+  -212,
+  1215,
+  -614,
+  -89,
+  230,
+  -76,
+  -10
+};
+
+
+
 #if 0
 
 
@@ -1039,8 +1254,69 @@ static int16_t filter_taps[FILTER_TAP_NUM] = {
 #undef MAX_TAP_NUM
 #define MAX_TAP_NUM  SBB_LPF_TAP_NUM
 #endif
-volatile int16_t i_s_raw[MAX_TAP_NUM], q_s_raw[MAX_TAP_NUM];      // Raw I/Q samples minus DC bias
-volatile int16_t a_s_raw[MAX_TAP_NUM];             // Raw MIC samples, minus DC bias
+// Delay lines are circular buffers with double length: each new sample is written at pos and pos+MAX_TAP_NUM
+// so the last N samples are always one contiguous window  &x_s_raw[pos + MAX_TAP_NUM - N + 1]  (oldest first)
+// no shift of the delay line at each sample
+int16_t i_s_raw[2*MAX_TAP_NUM], q_s_raw[2*MAX_TAP_NUM];      // Raw I/Q samples minus DC bias
+int16_t a_s_raw[2*MAX_TAP_NUM];             // Raw MIC samples, minus DC bias
+uint16_t iq_s_raw_pos = 0;     // last written position of i_s_raw[] q_s_raw[]
+uint16_t a_s_raw_pos = 0;      // last written position of a_s_raw[]
+
+
+
+/**************************************************************************************
+ * Folded FIR for the symmetric (linear phase) filter tables, NTAPS odd
+ * x[0] = oldest .. x[NTAPS-1] = newest sample, h[] = taps
+ * accu = x[mid]*h[mid] + sum (x[k] + x[NTAPS-1-k]) * h[k]   k = 0 .. mid-1
+ * = half the multiplications, the recursive template unrolls the loop for each NTAPS
+ **************************************************************************************/
+template <uint16_t NTAPS, uint16_t K>
+struct fir_fold
+{
+  static inline int32_t mac(const int16_t *x, const int16_t *h)
+  {
+    return ((int32_t)x[K] + x[NTAPS-1u-K]) * h[K] + fir_fold<NTAPS, K-1u>::mac(x, h);
+  }
+  static inline void mac_iq(const int16_t *xi, const int16_t *xq, const int16_t *h, int32_t &ai, int32_t &aq)
+  {
+    ai += ((int32_t)xi[K] + xi[NTAPS-1u-K]) * h[K];
+    aq += ((int32_t)xq[K] + xq[NTAPS-1u-K]) * h[K];
+    fir_fold<NTAPS, K-1u>::mac_iq(xi, xq, h, ai, aq);
+  }
+};
+template <uint16_t NTAPS>
+struct fir_fold<NTAPS, 0>
+{
+  static inline int32_t mac(const int16_t *x, const int16_t *h)
+  {
+    return ((int32_t)x[0] + x[NTAPS-1u]) * h[0];
+  }
+  static inline void mac_iq(const int16_t *xi, const int16_t *xq, const int16_t *h, int32_t &ai, int32_t &aq)
+  {
+    ai += ((int32_t)xi[0] + xi[NTAPS-1u]) * h[0];
+    aq += ((int32_t)xq[0] + xq[NTAPS-1u]) * h[0];
+  }
+};
+
+// one channel (MIC)
+template <uint16_t NTAPS>
+int32_t fir_sym(const int16_t *x, const int16_t *h)
+{
+  static_assert((NTAPS & 1u) && (NTAPS >= 3u), "fir_sym needs odd number of taps");
+  return (int32_t)x[NTAPS/2u] * h[NTAPS/2u] + fir_fold<NTAPS, (NTAPS/2u)-1u>::mac(x, h);
+}
+
+// I and Q pair with the same taps
+template <uint16_t NTAPS>
+void fir_sym_iq(const int16_t *xi, const int16_t *xq, const int16_t *h, int32_t *i_accu, int32_t *q_accu)
+{
+  static_assert((NTAPS & 1u) && (NTAPS >= 3u), "fir_sym_iq needs odd number of taps");
+  int32_t ai = (int32_t)xi[NTAPS/2u] * h[NTAPS/2u];
+  int32_t aq = (int32_t)xq[NTAPS/2u] * h[NTAPS/2u];
+  fir_fold<NTAPS, (NTAPS/2u)-1u>::mac_iq(xi, xq, h, ai, aq);
+  *i_accu = ai;
+  *q_accu = aq;
+}
 
 
 
@@ -1062,7 +1338,7 @@ volatile int16_t a_s_raw[MAX_TAP_NUM];             // Raw MIC samples, minus DC
 volatile int32_t peak_avg_shifted=0;     // signal level detector after AGC = average of positive values
 volatile int16_t peak_avg_diff_accu=0;   // Log peak level integrator
 volatile uint16_t agc_gain=((AGC_GAIN_MAX/2u)+1u);   // AGC gain/attenuation - starts at the middle
-uint16_t volatile fft_gain = 8;
+uint16_t volatile rx_gain = 8;
 #define AGC_REF		3u //6
 #define AGC_DECAY	8192u
 #define AGC_ATTACK_FAST	 32u  //64
@@ -1093,40 +1369,124 @@ void dsp_setagc(int agc)
 
 
 
-uint16_t mode_filter_tap_num = CW_BPF_TAP_NUM;
-int16_t *mode_filter_taps = cw_bpf_taps;
-
 /**************************************************************************************
  * MODE is modulation/demodulation 
- * This setting steers the signal processing branch chosen
+ * One entry of dsp_mode_tab[] for each mode: mode filter, demodulator (RX) and modulator (TX)
+ * rx() and tx() take the pointer once for each sample and make one call, no switch on the mode
+ * dsp_setmode() changes only the pointer = the mode changes between two samples, never in the middle
+ * new mode = new demod / mod functions and one more entry on the table
  **************************************************************************************/
-uint16_t dsp_mode;				// For values see hmi.c, assume {USB,LSB,AM,CW}
-void dsp_setmode(int mode)  //MODE_USB=0 MODE_LSB=1  MODE_AM=2  MODE_CW=3
+typedef struct
 {
-	dsp_mode = (uint16_t)mode;
+  uint16_t mode;                  // MODE_USB MODE_LSB MODE_AM MODE_CW MODE_SAM...  (index on hmi_o_mode[])
+  uint16_t filter_tap_num;        // mode filter: RX I Q and TX MIC
+  const int16_t *filter_taps;
+  int32_t (*fir)(const int16_t *x, const int16_t *h);     // folded FIR for the mode filter
+  void (*fir_iq)(const int16_t *xi, const int16_t *xq, const int16_t *h, int32_t *i_accu, int32_t *q_accu);
+  int16_t (*demod)(const int16_t *iw, const int16_t *qw);     // filtered I Q (HILBERT_TAP_NUM, [0] oldest) to audio
+  void (*mod)(const int16_t *aw, int16_t *ih, int16_t *qh);   // filtered MIC (HILBERT_TAP_NUM, [0] oldest) to I Q
+  bool tx_filter;                 // MIC through the mode filter  (false = I Q generated by mod())
+  bool rx_audio_8k;               // RX audio process @8kHz (narrow filter, half of the time)
+  bool vox;                       // VOX can start TX
+  bool agc;                       // AGC on the RX input  (false = full gain, FM does not depend on the level)
+} dsp_mode_t;
+
+static int16_t demod_usb(const int16_t *iw, const int16_t *qw);
+static int16_t demod_lsb(const int16_t *iw, const int16_t *qw);
+static int16_t demod_am(const int16_t *iw, const int16_t *qw);
+static int16_t demod_sam(const int16_t *iw, const int16_t *qw);
+static int16_t demod_sam_usb(const int16_t *iw, const int16_t *qw);
+static int16_t demod_sam_lsb(const int16_t *iw, const int16_t *qw);
+static int16_t demod_fm(const int16_t *iw, const int16_t *qw);
+static void mod_usb(const int16_t *aw, int16_t *ih, int16_t *qh);
+static void mod_lsb(const int16_t *aw, int16_t *ih, int16_t *qh);
+static void mod_am(const int16_t *aw, int16_t *ih, int16_t *qh);
+static void mod_cw(const int16_t *aw, int16_t *ih, int16_t *qh);
+static void mod_fm(const int16_t *aw, int16_t *ih, int16_t *qh);
+
+#define DSP_NUM_MODE   8
+const dsp_mode_t dsp_mode_tab[DSP_NUM_MODE] =
+{
+  // mode,  filter: taps num, taps, FIR MIC, FIR I Q,  demod,  mod,  tx_filter,  rx_audio_8k,  vox,  agc
+  { MODE_USB,  SSB_LPF_TAP_NUM, ssb_lpf_taps, fir_sym<SSB_LPF_TAP_NUM>, fir_sym_iq<SSB_LPF_TAP_NUM>, demod_usb,     mod_usb, true,  false, true,  true  },
+  { MODE_LSB,  SSB_LPF_TAP_NUM, ssb_lpf_taps, fir_sym<SSB_LPF_TAP_NUM>, fir_sym_iq<SSB_LPF_TAP_NUM>, demod_lsb,     mod_lsb, true,  false, true,  true  },
+  { MODE_AM,   AM_LPF_TAP_NUM,  am_lpf_taps,  fir_sym<AM_LPF_TAP_NUM>,  fir_sym_iq<AM_LPF_TAP_NUM>,  demod_am,      mod_am,  true,  false, true,  true  },
+  { MODE_CW,   CW_BPF_TAP_NUM,  cw_bpf_taps,  fir_sym<CW_BPF_TAP_NUM>,  fir_sym_iq<CW_BPF_TAP_NUM>,  demod_lsb,     mod_cw,  false, true,  false, true  },   // RX CW = LSB
+  { MODE_SAM,  AM_LPF_TAP_NUM,  am_lpf_taps,  fir_sym<AM_LPF_TAP_NUM>,  fir_sym_iq<AM_LPF_TAP_NUM>,  demod_sam,     mod_am,  true,  false, true,  true  },   // synchronous AM, TX = AM
+  { MODE_SAMU, AM_LPF_TAP_NUM,  am_lpf_taps,  fir_sym<AM_LPF_TAP_NUM>,  fir_sym_iq<AM_LPF_TAP_NUM>,  demod_sam_usb, mod_am,  true,  false, true,  true  },
+  { MODE_SAML, AM_LPF_TAP_NUM,  am_lpf_taps,  fir_sym<AM_LPF_TAP_NUM>,  fir_sym_iq<AM_LPF_TAP_NUM>,  demod_sam_lsb, mod_am,  true,  false, true,  true  },
+  { MODE_FM,   FM_LPF_TAP_NUM,  fm_lpf_taps,  fir_sym<FM_LPF_TAP_NUM>,  fir_sym_iq<FM_LPF_TAP_NUM>,  demod_fm,      mod_fm,  true,  false, true,  false },   // NBFM, no AGC
+};
+const dsp_mode_t * volatile dsp_mode_p = &dsp_mode_tab[MODE_USB];
+static void dsp_shift_update(void);
 
-  //mode filter selection
-  //MODE_USB=0 MODE_LSB=1  MODE_AM=2  MODE_CW=3
-  if(dsp_mode < 2)  //SSB
+void dsp_setmode(int mode)  //MODE_USB=0 MODE_LSB=1  MODE_AM=2  MODE_CW=3  MODE_SAM=4  MODE_SAMU=5  MODE_SAML=6  MODE_FM=7
+{
+  if((mode >= 0) && (mode < DSP_NUM_MODE))
   {
-    mode_filter_tap_num = SSB_LPF_TAP_NUM;      // band pass filter for SSB
-    mode_filter_taps = ssb_lpf_taps;
+    dsp_mode_p = &dsp_mode_tab[mode];     // one write, the IRQ sees the old or the new mode
+    dsp_shift_update();                   // RX audio rate may change (CW @8kHz)
   }
-  else if(dsp_mode == MODE_AM)  //AM
+}
+
+int dsp_getmode(void)
+{
+  return(dsp_mode_p->mode);
+}
+
+
+
+/**************************************************************************************
+ * TUNING, RIT, XIT, IF SHIFT with complex NCO mixers (nco.h), Q15 sin/cos table
+ * RX, before the decimator:    I Q * e^-j(tune)        @fsamp_ch, pan tuning only (tune > DSP_TUNE_MAX_HZ, core1)
+ *     before the mode filter:  I Q * e^-j(rit+ifs)     @audio rate, the RX freq goes to -ifs
+ *                              + e^-j(tune) when tune <= DSP_TUNE_MAX_HZ (core0, core1 does not mix)
+ *                              up to rx() rate / 4 (decimator passband, CW @8kHz Nyquist), more goes to the decimator mixer
+ *     after the mode filter:   I Q * e^+j(ifs)         back to 0Hz, the filter passband moved by ifs
+ * TX, after the modulator:     mod() makes e^-jwt for a USB tone (Q = -H(a)), so the shift up
+ *                              is I Q * e^-j(tune+xit),  only up to DSP_TUNE_MAX_HZ (16kHz rate)
+ *                              farther = TX muted until hmi.c moves the Si5351 to the tuned freq
+ * the Si5351 does not move for small steps, nor for pan tuning inside the waterfall (DSP_PAN_MAX_HZ)
+ * the steps are calculated here (int64 division), rx() and tx() only add them  (one 32 bits write)
+ **************************************************************************************/
+volatile int32_t dsp_tune_hz = 0;     // tuned freq - Si5351 freq
+volatile int32_t rit_hz = 0;
+volatile int32_t xit_hz = 0;
+volatile int32_t if_shift_hz = 0;
+nco_t rx_nco_pre, rx_nco_post;        // step 0 = mixer off
+nco_t tx_nco;
+volatile bool tx_tune_mute = false;   // tuned freq out of the tx_nco range
+nco_t rx_pan_nco;                     // core1, @fsamp_ch
+volatile uint16_t rx_pan_new = 1;     // new rx_pan_hz or fsamp_ch, core1 calculates the rx_pan_nco step
+volatile int32_t rx_pan_hz = 0;       // shift done by rx_pan_nco (0 = all on the audio rate mixer)
+
+static int32_t dsp_shift_limit(int32_t hz, int32_t max_hz)
+{
+  if(hz > max_hz)
   {
-    mode_filter_tap_num = AM_LPF_TAP_NUM;      // band pass filter for AM
-    mode_filter_taps = am_lpf_taps;
+    return(max_hz);
   }
-  else  //CW
+  if(hz < -max_hz)
   {
-    mode_filter_tap_num = CW_BPF_TAP_NUM;      // band pass filter for CW
-    mode_filter_taps = cw_bpf_taps;
+    return(-max_hz);
   }
+  return(hz);
 }
 
-int dsp_getmode(void)
+static void dsp_shift_update(void)
 {
-  return(dsp_mode);
+  uint32_t fs_rx = (dsp_mode_p->rx_audio_8k) ? (FSAMP_AUDIO/2u) : FSAMP_AUDIO;     // rx() rate
+  int32_t pan_hz, pre_hz, pre_lim_hz;
+
+  tx_tune_mute = (dsp_tune_hz > DSP_TUNE_MAX_HZ) || (dsp_tune_hz < -DSP_TUNE_MAX_HZ);
+  pan_hz = tx_tune_mute ? dsp_tune_hz : 0;      // out of the audio rate range = pan tuning
+  pre_hz = (dsp_tune_hz - pan_hz) + rit_hz + if_shift_hz;
+  pre_lim_hz = dsp_shift_limit(pre_hz, (int32_t)(fs_rx/4u));    // 4kHz @16kHz, 2kHz @8kHz
+  rx_pan_hz = pan_hz + (pre_hz - pre_lim_hz);   // the excess before the decimator, same total shift
+  rx_pan_new = 1;
+  nco_set_freq(&rx_nco_pre, -pre_lim_hz, fs_rx);
+  nco_set_freq(&rx_nco_post, if_shift_hz, fs_rx);
+  nco_set_freq(&tx_nco, tx_tune_mute ? 0 : -(dsp_tune_hz + xit_hz), FSAMP_AUDIO);      // tx() always @16kHz
 }
 
 
@@ -1184,289 +1544,660 @@ void dsp_setvox(int vox)
 //   the number of samples summed to generate the audio sample = 10   to make a low pass <10kHz
 //all samples have a bias value (half of Vref) and for digital filter an FFT they will be shifted to zero, removing the bias value
 //the audio samples are taken always, every time DMA interrupt, 
-//fft_samp[] is a buffer for the FFT samples 
-//the samples for FFT are taken from time to time when FFT to waterfall graphic is ready with last samples
+//fft_samp[] is a ring with the last I Q samples, written on every block (no stop and wait for the display)
+//core1 takes the latest samples for each FFT, a new FFT each hop (overlap 0 50 75%)
 //there are some extra previous samples for FFT/Hilbert/Graph because to calculate the first result, it needs some previous samples
 #define BLOCK_NSAMP    (FSAMP/FSAMP_AUDIO)    //block = 480k / 16k = 30 samples
-#define BLOCK_NSET     (BLOCK_NSAMP/3)        //block = 10 sets of 3 samples
-#define NBLOCK       ((FFT_NSAMP+(BLOCK_NSET-1)) / BLOCK_NSET)  // number of blocks necessary for FFT  320 / 30 = 10.666  =11
-#if LOW_PASS_16KHZ == LOW_PASS_16KHZ_AVERAGE_SUM
-#define ADC_NUM_BLOCK  (2u)  //save last 2 blocks
-#define ADC_NUM_BLOCK_MASK  (1u)  // 0 - 1
-#endif
-#if LOW_PASS_16KHZ == LOW_PASS_16KHZ_FIR
-#define ADC_NUM_BLOCK  (8u)  //save last 8 blocks
-#define ADC_NUM_BLOCK_MASK  (7u)  // 0 - 7
+#define ADC_NUM_CH     3u                     //0=Q  1=I  2=MIC  (round robin order)
+#define ADC_CH_MIC     2u
+#define BLOCK_NSET_MAX (BLOCK_NSAMP/2u)       //block = 10 sets of 3 samples (I Q MIC)  or  15 sets of 2 samples (I Q)
+volatile uint16_t adc_num_ch = ADC_NUM_CH;    //ADC channel plan, changed by dma_handler() between blocks
+volatile uint16_t block_nset = (BLOCK_NSAMP/ADC_NUM_CH);   //sets in one block = decimation ratio to 16kHz
+volatile uint32_t fsamp_ch = (FSAMP/ADC_NUM_CH);
+volatile uint16_t fft_fres = (uint16_t)((FSAMP/ADC_NUM_CH)/FFT_NSAMP_DEFAULT);
+// DMA blocks: one processed by dma_handler, one being written, one armed (chained DMA)  (FIR history is kept in dec_hist[])
+#define ADC_NUM_BLOCK  (4u)
+#define ADC_NUM_BLOCK_MASK  (3u)  // 0 - 3
+// the DMA writes wrap inside adc_samp[] (write ring, aligned power of 2): a chained channel restarted from its last
+// address (dma_handler late, core1 stopped) can not write out of the array,  dma_handler() starts the capture again
+#define ADC_BLOCK_STRIDE    32u   // samples between two blocks, power of 2 >= BLOCK_NSAMP
+#define ADC_SAMP_RING_BITS  8u    // 4 blocks x 32 samples x 2 bytes = 256 bytes
+#if (BLOCK_NSAMP > ADC_BLOCK_STRIDE) || ((ADC_NUM_BLOCK * ADC_BLOCK_STRIDE * 2u) != (1u << ADC_SAMP_RING_BITS))
+#error "adc_samp[] must be ADC_NUM_BLOCK blocks of ADC_BLOCK_STRIDE >= BLOCK_NSAMP samples = 2^ADC_SAMP_RING_BITS bytes"
 #endif
-volatile int16_t adc_samp[ADC_NUM_BLOCK][BLOCK_NSAMP] = { 0 };  //samples buffer    0-1 used for I and Q  3=MIC=VOX  [NL][NCOL]
-volatile uint16_t adc_samp_block_pos = 0;       //actual sample block reading by ADC and DMA
+volatile int16_t adc_samp[ADC_NUM_BLOCK][ADC_BLOCK_STRIDE] __attribute__((aligned(1u << ADC_SAMP_RING_BITS))) = { 0 };  //samples buffer    0-1 used for I and Q  3=MIC=VOX  [NL][NCOL]
+volatile uint16_t adc_samp_block_pos = 1;       //actual sample block reading by ADC and DMA  (by the other chained channel)
 volatile uint16_t adc_samp_last_block_pos = 0;  //last sample block read
+volatile int16_t adc_samp_sum[ADC_NUM_BLOCK][3] = { 0 };  //save the sum of each block  12 bits = 0-4095 * 10  must fit in 16 bits
+int16_t cw_samp_sum[2];    //I Q from the first of the two blocks used for CW @ 8kHz
+// last block without bias, one contiguous array for each channel (structure of arrays),  all consumers run with unit stride
+int16_t adc_ch_samp[ADC_NUM_CH][BLOCK_NSET_MAX];
+int16_t rx_pan_samp[2][BLOCK_NSET_MAX];       // I Q mixed to the tuned freq (RE IM), input of the decimator
+
 #if LOW_PASS_16KHZ == LOW_PASS_16KHZ_FIR
-volatile uint16_t adc_samp_last_block_pos3 = 0;  //last sample block read
-volatile uint16_t adc_samp_last_block_pos2 = 0;  //last sample block read
-volatile uint16_t adc_samp_last_block_pos1 = 0;  //last sample block read
+/*
+Decimator 160kHz -> 16kHz  (one output for each DEC_RATIO sets of I Q MIC = one per block)
+Low pass filter with extra attenuation to avoid hearing some one >16kHz away (attenuate an strong station away a multiple of 16kHz)
+sampling frequency: 160000 Hz
+* 0 Hz - 4000 Hz
+  gain = 1
+* 13000 Hz - 80000 Hz
+  desired attenuation = -63 dB  (extra attenuation)
+Only the output samples used at 16kHz are calculated (polyphase decimation), with the folded symmetric FIR
+The history is a contiguous window for each channel: dec_hist[ch][] is a circular buffer of blocks with double length, each block written twice
+*/
+#define DEC_LPF_TAP_NUM   33
+static const int16_t dec_lpf_taps[DEC_LPF_TAP_NUM] = {
+  29, 59, 114, 195, 307, 453, 635, 849, 1091, 1353, 1622, 1885, 2127, 2334, 2493, 2593,
+  2627,
+  2593, 2493, 2334, 2127, 1885, 1622, 1353, 1091, 849, 635, 453, 307, 195, 114, 59, 29
+};
+/*
+Same filter for I Q only @240kHz (decimation 15), Kaiser window (beta 5, fc 4000 Hz), same time span and DC gain
+  4000 Hz = -3.5dB    13000 Hz - 120000 Hz = -56dB
+*/
+#define DEC_LPF_240K_TAP_NUM   49
+static const int16_t dec_lpf_240k_taps[DEC_LPF_240K_TAP_NUM] = {
+  15, 28, 47, 73, 107, 150, 203, 267, 341, 425, 519, 621, 731, 847, 966, 1085, 1202, 1315, 1420, 1514, 1595, 1660, 1709, 1738,
+  1748,
+  1738, 1709, 1660, 1595, 1514, 1420, 1315, 1202, 1085, 966, 847, 731, 621, 519, 425, 341, 267, 203, 150, 107, 73, 47, 28, 15
+};
+#define DEC_SHIFT_IQ      13u            // >>16  *8 to give some gain (on average sum it is *10)
+#define DEC_SHIFT_MIC     12u            // MIC similar to the 10 samples sum,  >>3 later
+#define DEC_HIST_NSAMP    60u            // multiple of 10 and 15 sets (one block on each plan) and >= taps
+int16_t dec_hist[ADC_NUM_CH][2*DEC_HIST_NSAMP];
+uint16_t dec_hist_pos = 0;       // position of the next block to write
+
+/* one decimated output from a window of NTAPS samples (oldest first) */
+template <uint16_t NTAPS, uint16_t SHIFT>
+static inline int16_t decim_fir(const int16_t *x, const int16_t *h)
+{
+  static_assert((NTAPS & 1u) && (NTAPS >= 3u), "decim_fir needs odd number of taps");
+  return (int16_t)(((int32_t)x[NTAPS/2u] * h[NTAPS/2u] + fir_fold<NTAPS, (NTAPS/2u)-1u>::mac(x, h)) >> SHIFT);
+}
+#endif
+#if LOW_PASS_16KHZ == LOW_PASS_16KHZ_CIC
+/*
+Decimator 160kHz -> 16kHz with CIC  (R = block_nset = 10, M = 1, N = CIC_ORDER stages)
+with I Q only the input is 240kHz and R = 15, the nulls stay at the multiples of 16kHz
+integrators run @160kHz and the combs @16kHz, only adds and no multiplications
+the CIC has nulls at every multiple of 16kHz, exactly where the aliases fall
+CIC gain = R^N = 10^N  ->  12 bits + N*3.3 bits  fits in 32 bits,  the wrap around of the integrators is removed by the combs (uint32_t)
+the droop of the CIC in the audio band (-3.6dB @4kHz for N=4) is corrected by a short FIR @16kHz
+compensation FIR designed by least squares (7 taps, 1/CIC 0 Hz - 4000 Hz,  0 at 6500 Hz - 8000 Hz)
+  CIC + FIR:  0-4000 Hz = +-0.5dB   5000 Hz = -3.8dB   7000 Hz = -33dB
+*/
+#if CIC_ORDER == 4
+#define CIC_SHIFT_160K    13u            // 10^4 / 2^13 = 1.22
+#define CIC_SHIFT_240K    15u            // 15^4 / 2^15 = 1.54
+static const int16_t cic_comp_taps[7] = { 2963, -8438, 6902, 30351, 6902, -8438, 2963 };
+#elif CIC_ORDER == 5
+#define CIC_SHIFT_160K    16u            // 10^5 / 2^16 = 1.53
+#define CIC_SHIFT_240K    19u            // 15^5 / 2^19 = 1.45   (15^5 x 2^11 < 2^31)
+static const int16_t cic_comp_taps[7] = { 3585, -9753, 6543, 32570, 6543, -9753, 3585 };
+#else
+#error "CIC_ORDER must be 4 or 5"
+#endif
+#define CIC_COMP_TAP_NUM  7
+#define CIC_COMP_SHIFT    12u            // taps sum 1.0 in Q15 -> >>12 = *8  (on average sum it is *10)
+uint32_t cic_integ[ADC_NUM_CH][CIC_ORDER];       // I Q MIC integrators @160kHz
+uint32_t cic_comb[ADC_NUM_CH][CIC_ORDER];        // I Q MIC combs delay @16kHz
+int16_t cic_comp_hist[ADC_NUM_CH][2*CIC_COMP_TAP_NUM];   // compensation FIR delay lines, double length
+uint16_t cic_comp_pos = 0;
+uint16_t cic_shift = CIC_SHIFT_160K;
 #endif
-volatile int16_t adc_samp_sum[ADC_NUM_BLOCK][3] = { 0 };  //save the sum of each block  12 bits = 0-4095 * 10  must fit in 16 bits
 
 //bias = samples average = DC component, used to remome the DC from the samples
+//updated once per block from the block sum (same time constant as one update per sample)
 #define AVG_BIAS_SHIFT  8  //16   
-volatile int32_t adc_result_bias[3] = { (ADC_BIAS << AVG_BIAS_SHIFT), (ADC_BIAS << AVG_BIAS_SHIFT), (ADC_BIAS << AVG_BIAS_SHIFT) };  //bias starts at the middle
+#define BIAS_FREEZE_TX     //I Q bias is not updated during TX (the TX signal on the I Q inputs does not move the RX DC value),  MIC bias always updated
+int32_t adc_result_bias[3] = { (ADC_BIAS << AVG_BIAS_SHIFT), (ADC_BIAS << AVG_BIAS_SHIFT), (ADC_BIAS << AVG_BIAS_SHIFT) };  //bias starts at the middle
 volatile int16_t adc_result[3];   //
 
-#define FFT_NUM_BLOCK   (NBLOCK + 2u)  // number of blocks FFT + HILBERT_TAP_NUM = 15 = fit in 2*blocks=20
-volatile int16_t fft_samp[FFT_NUM_BLOCK][BLOCK_NSAMP];  //samples buffer for FFT and waterfall    only 0-1 used for I and Q  (3=MIC)  [NL][NCOL]
-volatile uint16_t fft_samp_block_pos = 0;    
-volatile uint16_t fft_samples_ready = 0;  //all buffer filled
-volatile uint16_t fft_display_graf_new = 0;   //new data for graphic ready
+// audio samples exchanged between core1 (ADC/DMA) and core0 (vox rx tx) with two single producer / single consumer rings
+// audio_in:  core1 writes I Q MIC (head),  core0 reads (tail)
+// audio_out: core0 writes PWM levels AUD I Q (head),  core1 reads and plays (tail)
+// head and tail are free running counters, index = counter & mask,  each one is written only by one core
+// core1 never waits: full input ring = overrun (sample dropped),  empty output ring = underrun (PWM level kept)
+// core0 never waits either: full output ring = out overrun (level dropped)
+// core1 rings the FIFO doorbell once per AUDIO_BLOCK_NSAMP samples, core0 processes all samples available
+#if (AUDIO_RING_NSAMP & (AUDIO_RING_NSAMP-1u)) || (AUDIO_RING_NSAMP < (4u*AUDIO_BLOCK_NSAMP))
+#error "AUDIO_RING_NSAMP must be a power of 2 and >= 4 x AUDIO_BLOCK_NSAMP"
+#endif
+#define AUDIO_RING_MASK     (AUDIO_RING_NSAMP-1u)
+#define AUDIO_OUT_PREFILL   (2u*AUDIO_BLOCK_NSAMP)   // output latency: one block to collect + one block to process
+volatile int16_t audio_in[AUDIO_RING_NSAMP][3];     // [pos][I Q MIC]  = adc_result[] for each sample
+volatile uint16_t audio_out[AUDIO_RING_NSAMP][3];   // [pos][AUD I Q]  PWM levels
+#define AUDIO_OUT_AUD   0
+#define AUDIO_OUT_I     1
+#define AUDIO_OUT_Q     2
+volatile uint32_t audio_in_head = 0;      // written by core1
+volatile uint32_t audio_in_tail = 0;      // written by core0
+volatile uint32_t audio_out_head = AUDIO_OUT_PREFILL;   // written by core0
+volatile uint32_t audio_out_tail = 0;     // written by core1
+uint32_t audio_in_signal = 0;             // core1: head at last doorbell
+volatile uint32_t audio_overrun_count = 0;    // input samples dropped, core0 late
+volatile uint32_t audio_underrun_count = 0;   // output samples missing, core0 late
+volatile uint32_t audio_out_overrun_count = 0;   // output samples dropped, output ring full (core1 late)
+volatile uint32_t audio_fifo_busy_count = 0;  // doorbell not sent, FIFO full (core0 still busy)
+volatile uint16_t dac_audio_level = DAC_BIAS, dac_i_level = DAC_BIAS, dac_q_level = DAC_BIAS;   // last PWM level from rx() and tx(), kept when not written
+
+#if FFT_METHOD == FFT_REAL_HILBERT
+#define FFT_SAMP_EXTRA  14u     // HILBERT_TAP_NUM-1 previous samples
+#else
+#define FFT_SAMP_EXTRA  0u      // complex FFT uses the I Q samples direct, no extra samples for Hilbert
+#endif
+// ring of 2 x the biggest FFT:  core1 reads the latest samples while dma_handler() keeps writing the other half
+#define FFT_SAMP_NSAMP  (2u*FFT_NSAMP_MAX)
+#define FFT_SAMP_MASK   (FFT_SAMP_NSAMP-1u)
+volatile int16_t fft_samp[2][FFT_SAMP_NSAMP];  //samples ring for FFT and waterfall, one array for 0=Q and 1=I  (MIC is not saved)
+volatile uint32_t fft_samp_pos = 0;         //samples written since the start (wraps), ring index = pos & FFT_SAMP_MASK
+volatile uint32_t fft_samp_start = 0;       //fft_samp_pos when the samples were restarted (new rate or zoom)
+volatile uint16_t fft_overlap = FFT_OVERLAP_DEFAULT;   //% of the last FFT samples used again on the next one
+uint32_t fft_samp_rd;          //core1: ring position (as fft_samp_pos) of the first sample of the FFT in progress
+uint32_t fft_samp_next = 0;    //core1: fft_samp_pos for the next FFT = last one + hop
+#define FFT_SAMP(ch, n)   fft_samp[ch][(fft_samp_rd + (n)) & FFT_SAMP_MASK]
+volatile uint16_t fft_nsamp = FFT_NSAMP_DEFAULT;
+volatile uint16_t fft_nsamp_req = FFT_NSAMP_DEFAULT;   //new size asked by dsp_set_fft_size(), changed by core1 between two FFTs
+volatile uint16_t fft_samp_need = FFT_NSAMP_DEFAULT + FFT_SAMP_EXTRA;
+volatile uint16_t fft_display_graf_new = 0;   //new waterfall line ready, until the display takes it the next FFTs are added to the same line
+
+#ifdef EXCHANGE_I_Q
+#define FFT_CH_RE  0u    // real part of the complex sample (the "I" that goes to the FFT)
+#define FFT_CH_IM  1u
+#else
+#define FFT_CH_RE  1u
+#define FFT_CH_IM  0u
+#endif
+
+// zoom FFT: the I Q samples are mixed with the NCO (zoom center moved to 0Hz) and decimated by a CIC3
+// the same FFT points show fsamp_ch / fft_zoom around hmi_freq + fft_zoom_offset
+#define ZOOM_CIC_ORDER  3u
+volatile uint16_t fft_zoom = 1;             // 1 = no zoom   2 4 8 16 = decimation ratio
+volatile int32_t fft_zoom_offset = 0;       // Hz, zoom center from the tuned freq
+volatile uint16_t fft_zoom_req = 1;         // asked by dsp_set_fft_zoom(), applied by dma_handler()
+volatile int32_t fft_zoom_offset_req = 0;
+volatile uint16_t fft_zoom_new = 0;         // new zoom asked
+uint16_t fft_zoom_shift = 0;                // log2(fft_zoom)
+uint16_t fft_zoom_cnt = 0;                  // input samples for the next output
+nco_t fft_zoom_nco;
+uint32_t fft_zoom_integ[2][ZOOM_CIC_ORDER];   // wraps around, result is still right (two's complement)
+uint32_t fft_zoom_comb[2][ZOOM_CIC_ORDER];
 
 volatile int16_t aud_samp[AUD_NUM_VAR][AUD_NUM_SAMP];  //samples buffer for audio process, filter and demodulation
 volatile uint16_t aud_samp_block_pos = 0;    
 volatile uint16_t aud_samples_state = AUD_STATE_SAMP_IN;  //filling buffer
 
 volatile uint16_t i_int, j_int;
-volatile uint16_t cw_int_count=0;  //used to count 2 times the 16kHz int to generate the 8kHz for CW (only for CW reception)
-#if TX_METHOD == PHASE_AMPLITUDE    // uSDX TX method used for Class E RF amplifier
-volatile uint16_t st_int_count=0;
-#endif
+
+
 /************************************************************************************** 
- * CORE1:  DMA IRQ
- * dma handler - IRQ when a block of samples was read
- * take a block of samples, calculate average for I Q MIC and store data for FFT
- * it takes < 28us (1/16kHz = 62.5us)
+ * CORE1:  inside DMA IRQ
+ * store one audio sample (I Q MIC) in the input ring and play the next output sample from core0
+ * every AUDIO_BLOCK_NSAMP samples, invoque FIFO IRQ on Core0 (without waiting if the FIFO is full)
  **************************************************************************************/
-void __not_in_flash_func(dma_handler)(void)
-//void dma_handler() __attribute__ ((section (".scratch_x.")));
-//void dma_handler() 
+static inline void audio_ring_sample(int16_t s_i, int16_t s_q, int16_t s_mic)
 {
-  //*** the next DMA instructions must happen as fast as possible
-  //*** do not include anything here
-
-  // Clear the interrupt request.
-  dma_hw->ints0 = 1u << dma_chan;
-  // Give the channel a new wave table entry to write to, and re-trigger it
-  dma_channel_set_write_addr(dma_chan, &adc_samp[adc_samp_block_pos][0], true);
-  
+  uint32_t head = audio_in_head;
+  uint32_t tail = audio_out_tail;
 
-  gpio_set_mask(1<<14);   //GP14
+  if((head - audio_in_tail) < AUDIO_RING_NSAMP)
+  {
+    audio_in[head & AUDIO_RING_MASK][0] = s_i;
+    audio_in[head & AUDIO_RING_MASK][1] = s_q;
+    audio_in[head & AUDIO_RING_MASK][2] = s_mic;
+    __dmb();                      // sample written before the new head is seen by core0
+    audio_in_head = head + 1u;
+  }
+  else
+  {
+    audio_overrun_count++;
+  }
 
+  if(tail != audio_out_head)
+  {
+    __dmb();                      // head read before the output sample
+    pwm_set_chan_level(dac_audio, PWM_CHAN_A, audio_out[tail & AUDIO_RING_MASK][AUDIO_OUT_AUD]);
+    pwm_set_gpio_level(21, audio_out[tail & AUDIO_RING_MASK][AUDIO_OUT_I]);
+    pwm_set_gpio_level(20, audio_out[tail & AUDIO_RING_MASK][AUDIO_OUT_Q]);
+    __dmb();
+    audio_out_tail = tail + 1u;
+  }
+  else
+  {
+    audio_underrun_count++;       // keep last PWM level
+  }
 
+  if((audio_in_head - audio_in_signal) >= AUDIO_BLOCK_NSAMP)
+  {
+    audio_in_signal = audio_in_head;
+    if(multicore_fifo_wready())
+    {
+      // invoque FIFO IRQ on Core0 to use the audio_in[] samples (there is no time for all in one core)
+      multicore_fifo_push_blocking(FIFO_IQ_SAMPLE);   // does not block, there is space
+    }
+    else
+    {
+      audio_fifo_busy_count++;    // core0 did not take the last doorbell yet, it will process these samples too
+    }
+  }
+}
 
-  //prepare I Q and MIC audio samples
-  //sum last samples to make a low frequency average sample (160kHz to 16kHz sample freq)
 
 
-  // average method used for BIAS:
-  // example:  average result = average value x4 = ave_x4
-  //           ave_x4 += new_value - (ave_x4/4)
 
 
 
-  //init first sum = value  
-  i_int=0;
 
-  // bias = samples average = DC value from the samples  (it is always positive)
-  adc_result_bias[0] += (int16_t)(adc_samp[adc_samp_last_block_pos][i_int] - (adc_result_bias[0] >> AVG_BIAS_SHIFT));
-  // remove bias (avg) from samples
-  adc_samp[adc_samp_last_block_pos][i_int] -= (adc_result_bias[0] >> AVG_BIAS_SHIFT);
-  // sum of last 10 samples = all block
-#if LOW_PASS_16KHZ == LOW_PASS_16KHZ_AVERAGE_SUM
-  adc_samp_sum[adc_samp_last_block_pos][0] = adc_samp[adc_samp_last_block_pos][i_int]; //block samples sum to subsample at lower frequency (it is a low pass filter too)  
-#endif
-  i_int++;
 
 
-  // bias = samples average = DC value from the samples  (it is always positive)
-  adc_result_bias[1] += (int16_t)(adc_samp[adc_samp_last_block_pos][i_int] - (adc_result_bias[1] >> AVG_BIAS_SHIFT));
-  // remove bias (avg) from samples
-  adc_samp[adc_samp_last_block_pos][i_int] -= (adc_result_bias[1] >> AVG_BIAS_SHIFT);
-  // sum of last 10 samples = all block
-#if LOW_PASS_16KHZ == LOW_PASS_16KHZ_AVERAGE_SUM
-  adc_samp_sum[adc_samp_last_block_pos][1] = adc_samp[adc_samp_last_block_pos][i_int]; //block samples sum to subsample at lower frequency (it is a low pass filter too)
+volatile uint16_t cw_int_count=0;  //used to count 2 times the 16kHz int to generate the 8kHz for CW (only for CW reception)
+#if TX_METHOD == PHASE_AMPLITUDE    // uSDX TX method used for Class E RF amplifier
+volatile uint16_t st_int_count=0;
 #endif
-  i_int++;
 
 
-  // bias = samples average = DC value from the samples  (it is always positive)
-  adc_result_bias[2] += (int16_t)(adc_samp[adc_samp_last_block_pos][i_int] - (adc_result_bias[2] >> AVG_BIAS_SHIFT));
-  // remove bias (avg) from samples
-  adc_samp[adc_samp_last_block_pos][i_int] -= (adc_result_bias[2] >> AVG_BIAS_SHIFT);
-  // sum of last 10 samples = all block
-  adc_samp_sum[adc_samp_last_block_pos][2] = adc_samp[adc_samp_last_block_pos][i_int]; //block samples sum to subsample at lower frequency (it is a low pass filter too)
-  i_int++;
+
+/************************************************************************************** 
+ * CORE1:  zoom FFT, apply the zoom asked by dsp_set_fft_zoom()
+ * called by dma_handler() between blocks
+ **************************************************************************************/
+static void fft_zoom_apply(void)
+{
+  uint16_t z = fft_zoom_req;
+
+  fft_zoom_new = 0;
+  fft_zoom = z;
+  fft_zoom_offset = (z > 1) ? fft_zoom_offset_req : 0;
+  for(fft_zoom_shift = 0; (1u << fft_zoom_shift) < z; fft_zoom_shift++) { }
+  fft_zoom_cnt = 0;
+  memset(fft_zoom_integ, 0, sizeof(fft_zoom_integ));
+  memset(fft_zoom_comb, 0, sizeof(fft_zoom_comb));
+  nco_set_freq(&fft_zoom_nco, fft_zoom_offset + dsp_tune_hz, fsamp_ch);     // from the Si5351 freq
+  fft_fres = (uint16_t)(fsamp_ch / ((uint32_t)fft_nsamp * z));
+  fft_samp_start = fft_samp_pos;     // FFT samples with one zoom only
+}
 
 
 
-  //sum += value
-  //save the samples sum for each block to make easy to get the last 16 samples average (10=full block,  6=partial)
-  for(; i_int<BLOCK_NSAMP; )
+/************************************************************************************** 
+ * CORE1:  zoom FFT, one block of I Q samples
+ * mix with the NCO:  (re + j.im) x (cos - j.sin) = zoom center moved to 0Hz
+ * decimate by fft_zoom with a CIC3 (gain = fft_zoom^3, removed by the shift)
+ * outputs saved on the fft_samp[] ring
+ **************************************************************************************/
+static void fft_zoom_block(uint16_t nset)
+{
+  uint32_t pos = fft_samp_pos;
+  int16_t c, s;
+  int32_t re, im, mr, mi;
+  uint32_t x[2], t;
+  uint16_t ch, k;
+  uint16_t gain_shift = ZOOM_CIC_ORDER * fft_zoom_shift;
+
+  for(uint16_t n=0; n<nset; n++)
   {
-    // bias = samples average = DC value from the samples  (it is always positive)
-    adc_result_bias[0] += (int16_t)(adc_samp[adc_samp_last_block_pos][i_int] - (adc_result_bias[0] >> AVG_BIAS_SHIFT));
-    // remove bias (avg) from samples
-    adc_samp[adc_samp_last_block_pos][i_int] -= (adc_result_bias[0] >> AVG_BIAS_SHIFT);
-    // sum of last 10 samples = all block
-#if LOW_PASS_16KHZ == LOW_PASS_16KHZ_AVERAGE_SUM
-    adc_samp_sum[adc_samp_last_block_pos][0] += adc_samp[adc_samp_last_block_pos][i_int]; //block samples sum to subsample at lower frequency (it is a low pass filter too)
-#endif
-    i_int++;
-
+    re = adc_ch_samp[FFT_CH_RE][n];
+    im = adc_ch_samp[FFT_CH_IM][n];
+    nco_next(&fft_zoom_nco, &c, &s);
+    mr = (re * c + im * s) >> 15;
+    mi = (im * c - re * s) >> 15;
+
+    x[0] = (uint32_t)mr;
+    x[1] = (uint32_t)mi;
+    for(ch=0; ch<2; ch++)
+    {
+      for(k=0; k<ZOOM_CIC_ORDER; k++)
+      {
+        fft_zoom_integ[ch][k] += x[ch];
+        x[ch] = fft_zoom_integ[ch][k];
+      }
+    }
 
-    // bias = samples average = DC value from the samples  (it is always positive)
-    adc_result_bias[1] += (int16_t)(adc_samp[adc_samp_last_block_pos][i_int] - (adc_result_bias[1] >> AVG_BIAS_SHIFT));
-    // remove bias (avg) from samples
-    adc_samp[adc_samp_last_block_pos][i_int] -= (adc_result_bias[1] >> AVG_BIAS_SHIFT);
-    // sum of last 10 samples = all block
-#if LOW_PASS_16KHZ == LOW_PASS_16KHZ_AVERAGE_SUM
-    adc_samp_sum[adc_samp_last_block_pos][1] += adc_samp[adc_samp_last_block_pos][i_int]; //block samples sum to subsample at lower frequency (it is a low pass filter too)
-#endif
-    i_int++;
+    if(++fft_zoom_cnt < fft_zoom)
+    {
+      continue;
+    }
+    fft_zoom_cnt = 0;
 
+    for(ch=0; ch<2; ch++)
+    {
+      for(k=0; k<ZOOM_CIC_ORDER; k++)
+      {
+        t = x[ch];
+        x[ch] -= fft_zoom_comb[ch][k];
+        fft_zoom_comb[ch][k] = t;
+      }
+    }
 
-    // bias = samples average = DC value from the samples  (it is always positive)
-    adc_result_bias[2] += (int16_t)(adc_samp[adc_samp_last_block_pos][i_int] - (adc_result_bias[2] >> AVG_BIAS_SHIFT));
-    // remove bias (avg) from samples
-    adc_samp[adc_samp_last_block_pos][i_int] -= (adc_result_bias[2] >> AVG_BIAS_SHIFT);
-    // sum of last 10 samples = all block
-    adc_samp_sum[adc_samp_last_block_pos][2] += adc_samp[adc_samp_last_block_pos][i_int]; //block samples sum to subsample at lower frequency (it is a low pass filter too)
-    i_int++;
+    fft_samp[FFT_CH_RE][pos & FFT_SAMP_MASK] = (int16_t)((int32_t)x[0] >> gain_shift);
+    fft_samp[FFT_CH_IM][pos & FFT_SAMP_MASK] = (int16_t)((int32_t)x[1] >> gain_shift);
+    pos++;
   }
+  fft_samp_pos = pos;
+}
 
 
 
+/************************************************************************************** 
+ * CORE1:  pan tuning inside the ADC band, I Q of the block * e^-j(tune) to the decimator
+ * the tuned freq goes to 0Hz and the Si5351 stays (the waterfall keeps the raw samples)
+ * an offset of up to DSP_PAN_MAX_HZ is out of the audio band, it can only be mixed before the decimator:
+ * one nco_mix per I Q set @240kHz on core1, only while pan tuned or with shifts out of the audio band
+ * (fine tuning, RIT and IF shift stay on core0 @audio rate)
+ * the mixed I Q can be sqrt(2) x the ADC range (both channels near full scale),
+ * clipped to the ADC range: the decimators are sized for 12 bits inputs (CIC5 @240kHz: 15^5 x 2^11 < 2^31)
+ **************************************************************************************/
+static void rx_pan_block(uint16_t nset)
+{
+  const int16_t *re = adc_ch_samp[FFT_CH_RE];
+  const int16_t *im = adc_ch_samp[FFT_CH_IM];
 
-
-#if LOW_PASS_16KHZ == LOW_PASS_16KHZ_FIR
+  for(uint16_t n=0; n<nset; n++)
+  {
+    int16_t x = re[n];
+    int16_t y = im[n];
+    nco_mix(&rx_pan_nco, &x, &y);
+    rx_pan_samp[0][n] = (x > (int16_t)ADC_BIAS) ? (int16_t)ADC_BIAS : ((x < -(int16_t)ADC_BIAS) ? -(int16_t)ADC_BIAS : x);
+    rx_pan_samp[1][n] = (y > (int16_t)ADC_BIAS) ? (int16_t)ADC_BIAS : ((y < -(int16_t)ADC_BIAS) ? -(int16_t)ADC_BIAS : y);
+  }
+}
 
 
-/*
-Low pass filter with extra attenuation to avoid hearing some one >16kHz away (attenuate an strong station away a multiple of 16kHz)
-sampling frequency: 160000 Hz
-* 0 Hz - 4000 Hz
-  gain = 1
-* 13000 Hz - 80000 Hz
-  desired attenuation = -63 dB  (extra attenuation)
 
-The sampling is at 160kHz but for audio we only need 16kHz samples, so the filter is at 160kHz with the output generated at 16kHz (process 1x at each 16kHz)
-*/
-  adc_samp_sum[adc_samp_last_block_pos][0] = (int16_t)((
-                                                        (adc_samp[adc_samp_last_block_pos3][21] * 29L) +
-                                                        (adc_samp[adc_samp_last_block_pos3][24] * 59L) +
-                                                        (adc_samp[adc_samp_last_block_pos3][27] * 114L) +
-                                                        (adc_samp[adc_samp_last_block_pos2][0] * 195L) + 
-                                                        (adc_samp[adc_samp_last_block_pos2][3] * 307L) + 
-                                                        (adc_samp[adc_samp_last_block_pos2][6] * 453L) +
-                                                        (adc_samp[adc_samp_last_block_pos2][9] * 635L) +
-                                                        (adc_samp[adc_samp_last_block_pos2][12] * 849L) +
-                                                        (adc_samp[adc_samp_last_block_pos2][15] * 1091L) +
-                                                        (adc_samp[adc_samp_last_block_pos2][18] * 1353L) +
-                                                        (adc_samp[adc_samp_last_block_pos2][21] * 1622L) +
-                                                        (adc_samp[adc_samp_last_block_pos2][24] * 1885L) +
-                                                        (adc_samp[adc_samp_last_block_pos2][27] * 2127L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][0] * 2334L) + 
-                                                        (adc_samp[adc_samp_last_block_pos1][3] * 2493L) + 
-                                                        (adc_samp[adc_samp_last_block_pos1][6] * 2593L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][9] * 2627L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][12] * 2593L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][15] * 2493L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][18] * 2334L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][21] * 2127L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][24] * 1885L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][27] * 1622L) +
-                                                        (adc_samp[adc_samp_last_block_pos][0] * 1353L) +
-                                                        (adc_samp[adc_samp_last_block_pos][3] * 1091L) +
-                                                        (adc_samp[adc_samp_last_block_pos][6] * 849L) +
-                                                        (adc_samp[adc_samp_last_block_pos][9] * 635L) +
-                                                        (adc_samp[adc_samp_last_block_pos][12] * 453L) +
-                                                        (adc_samp[adc_samp_last_block_pos][15] * 307L) +
-                                                        (adc_samp[adc_samp_last_block_pos][18] * 195L) +
-                                                        (adc_samp[adc_samp_last_block_pos][21] * 114L) +
-                                                        (adc_samp[adc_samp_last_block_pos][24] * 59L) +
-                                                        (adc_samp[adc_samp_last_block_pos][27] * 29L)   ) >> 13u);  // >>16  *8 to give some gain (on average sum it is *10)
-
-
-  adc_samp_sum[adc_samp_last_block_pos][1] = (int16_t)((
-                                                        (adc_samp[adc_samp_last_block_pos3][22] * 29L) +
-                                                        (adc_samp[adc_samp_last_block_pos3][25] * 59L) +
-                                                        (adc_samp[adc_samp_last_block_pos3][28] * 114L) +
-                                                        (adc_samp[adc_samp_last_block_pos2][1] * 195L) + 
-                                                        (adc_samp[adc_samp_last_block_pos2][4] * 307L) + 
-                                                        (adc_samp[adc_samp_last_block_pos2][7] * 453L) +
-                                                        (adc_samp[adc_samp_last_block_pos2][10] * 635L) +
-                                                        (adc_samp[adc_samp_last_block_pos2][13] * 849L) +
-                                                        (adc_samp[adc_samp_last_block_pos2][16] * 1091L) +
-                                                        (adc_samp[adc_samp_last_block_pos2][19] * 1353L) +
-                                                        (adc_samp[adc_samp_last_block_pos2][22] * 1622L) +
-                                                        (adc_samp[adc_samp_last_block_pos2][25] * 1885L) +
-                                                        (adc_samp[adc_samp_last_block_pos2][28] * 2127L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][1] * 2334L) + 
-                                                        (adc_samp[adc_samp_last_block_pos1][4] * 2493L) + 
-                                                        (adc_samp[adc_samp_last_block_pos1][7] * 2593L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][10] * 2627L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][13] * 2593L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][16] * 2493L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][19] * 2334L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][22] * 2127L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][25] * 1885L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][28] * 1622L) +
-                                                        (adc_samp[adc_samp_last_block_pos][1] * 1353L) +
-                                                        (adc_samp[adc_samp_last_block_pos][4] * 1091L) +
-                                                        (adc_samp[adc_samp_last_block_pos][7] * 849L) +
-                                                        (adc_samp[adc_samp_last_block_pos][10] * 635L) +
-                                                        (adc_samp[adc_samp_last_block_pos][13] * 453L) +
-                                                        (adc_samp[adc_samp_last_block_pos][16] * 307L) +
-                                                        (adc_samp[adc_samp_last_block_pos][19] * 195L) +
-                                                        (adc_samp[adc_samp_last_block_pos][22] * 114L) +
-                                                        (adc_samp[adc_samp_last_block_pos][25] * 59L) +
-                                                        (adc_samp[adc_samp_last_block_pos][28] * 29L)   ) >> 13u);  // >>16  *8 to give some gain (on average sum it is *10)
+/************************************************************************************** 
+ * CORE1:  stop the capture, both DMA channels idle
+ * the two channels are aborted with one write: aborted one after the other, the second could end
+ * its block between the two aborts and start the first one again by the chain
+ * the IRQ of the channels is disabled during the abort (RP2040-E13: an aborted channel can raise its IRQ)
+ **************************************************************************************/
+static void adc_dma_stop(void)
+{
+  uint32_t mask = (1u << dma_chan[0]) | (1u << dma_chan[1]);
+
+  adc_run(false);
+  while(!(adc_hw->cs & ADC_CS_READY_BITS)) { }    // last conversion done
+  dma_hw->inte0 &= ~mask;
+  dma_hw->abort = mask;
+  while(dma_hw->abort & mask) { }
+  while(dma_channel_is_busy(dma_chan[0]) || dma_channel_is_busy(dma_chan[1])) { }
+  adc_fifo_drain();
+  adc_hw->fcs = adc_hw->fcs | ADC_FCS_OVER_BITS;   // write 1 to clear
+  dma_hw->ints0 = mask;
+  dma_hw->inte0 |= mask;
+}
 
-   
 
 
-#if 0
-  adc_samp_sum[adc_samp_last_block_pos][0] = (int16_t)(((adc_samp[adc_samp_last_block_pos1][3] * 304L) + 
-                                                        (adc_samp[adc_samp_last_block_pos1][6] * 523L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][9] * 897L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][12] * 1366L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][15] * 1901L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][18] * 2454L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][21] * 2972L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][24] * 3394L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][27] * 3671L) +
-                                                        (adc_samp[adc_samp_last_block_pos][0] * 3768L) +
-                                                        (adc_samp[adc_samp_last_block_pos][3] * 3671L) +
-                                                        (adc_samp[adc_samp_last_block_pos][6] * 3394L) +
-                                                        (adc_samp[adc_samp_last_block_pos][9] * 2972L) +
-                                                        (adc_samp[adc_samp_last_block_pos][12] * 2454L) +
-                                                        (adc_samp[adc_samp_last_block_pos][15] * 1901L) +
-                                                        (adc_samp[adc_samp_last_block_pos][18] * 1366L) +
-                                                        (adc_samp[adc_samp_last_block_pos][21] * 897L) +
-                                                        (adc_samp[adc_samp_last_block_pos][24] * 523L) +
-                                                        (adc_samp[adc_samp_last_block_pos][27] * 304L)) >> 13u);  // >>16  *8 to give some gain (on average sum it is *10)
+/************************************************************************************** 
+ * CORE1:  start the capture as the setup: channel 0 on block 0, channel 1 chained on block 1
+ * only after adc_dma_stop() (both channels idle)
+ **************************************************************************************/
+static void adc_dma_start(void)
+{
+  dma_chan_irq = 0;
+  adc_samp_last_block_pos = 0;
+  adc_samp_block_pos = 1;
+  dma_channel_set_trans_count(dma_chan[1], BLOCK_NSAMP, false);
+  dma_channel_set_write_addr(dma_chan[1], &adc_samp[1][0], false);
+  dma_channel_set_trans_count(dma_chan[0], BLOCK_NSAMP, false);
+  dma_channel_set_write_addr(dma_chan[0], &adc_samp[0][0], true);
+  adc_run(true);
+}
 
+
+
+/************************************************************************************** 
+ * CORE1:  ADC channel plan
+ * stop the capture, change the ADC round robin and start again with block 0 = channel 0 first
+ * nch = 3:  I Q MIC @160kHz     nch = 2:  I Q @240kHz
+ * the block rate stays 16kHz, only the samples for each channel in a block change (10 or 15)
+ **************************************************************************************/
+static void adc_plan_set(uint16_t nch)
+{
+  adc_dma_stop();
+
+  adc_num_ch = nch;
+  block_nset = BLOCK_NSAMP / nch;
+  fsamp_ch = FSAMP / nch;
+  fft_fres = (uint16_t)(fsamp_ch / ((uint32_t)fft_nsamp * fft_zoom));
+  nco_set_freq(&fft_zoom_nco, fft_zoom_offset + dsp_tune_hz, fsamp_ch);
+  rx_pan_new = 1;
+  adc_select_input(0);
+  adc_set_round_robin((nch == ADC_NUM_CH) ? (0x01+0x02+0x04) : (0x01+0x02));
+
+  // decimator restarts with the new rate
+#if LOW_PASS_16KHZ == LOW_PASS_16KHZ_FIR
+  dec_hist_pos = 0;
+#endif
+#if LOW_PASS_16KHZ == LOW_PASS_16KHZ_CIC
+  memset(cic_integ, 0, sizeof(cic_integ));
+  memset(cic_comb, 0, sizeof(cic_comb));
+  cic_shift = (nch == ADC_NUM_CH) ? CIC_SHIFT_160K : CIC_SHIFT_240K;
+#endif
+  fft_samp_start = fft_samp_pos;     // FFT samples with one rate only
+
+  adc_dma_start();
+}
+
+
+
+/************************************************************************************** 
+ * CORE1:  DMA IRQ
+ * dma handler - IRQ when a block of samples was read
+ * take a block of samples, calculate average for I Q MIC and store data for FFT
+ * it takes < 28us (1/16kHz = 62.5us)
+ **************************************************************************************/
+void __not_in_flash_func(dma_handler)(void)
+//void dma_handler() __attribute__ ((section (".scratch_x.")));
+//void dma_handler() 
+{
+  //*** the next DMA instructions must happen as fast as possible
+  //*** do not include anything here
+
+#ifdef ADC_RX_IQ_ONLY
+  // MIC only on TX or with VOX enabled,  the block just captured is dropped when the plan changes
+  if((((tx_enabled == true) || (vox_level != VOX_OFF)) ? ADC_NUM_CH : (ADC_NUM_CH-1u)) != adc_num_ch)
+  {
+    adc_plan_set((adc_num_ch == ADC_NUM_CH) ? (ADC_NUM_CH-1u) : ADC_NUM_CH);
+    return;
+  }
+#endif
+
+  // both channels finished = this handler was late more than one block, the chain restarted the first channel
+  // from its last address (inside the write ring, not on a block):  drop the samples and start the capture again
+  if((dma_hw->ints0 & ((1u << dma_chan[0]) | (1u << dma_chan[1]))) == ((1u << dma_chan[0]) | (1u << dma_chan[1])))
+  {
+    dma_late_count++;
+    adc_dma_stop();
+    adc_dma_start();
+    fft_samp_start = fft_samp_pos;     // gap in the FFT samples
+    return;
+  }
+  // Clear the interrupt request of the finished channel (the other one, if set, calls this handler again)
+  dma_hw->ints0 = 1u << dma_chan[dma_chan_irq];
+  // the other channel is already writing adc_samp_block_pos (chained)
+  // prepare the finished channel for the block after it, without trigger = started by the chain
+  dma_channel_set_write_addr(dma_chan[dma_chan_irq], &adc_samp[(adc_samp_block_pos + 1u) & ADC_NUM_BLOCK_MASK][0], false);
+  dma_chan_irq ^= 1u;
+
+  // ADC FIFO overflow = DMA did not read in time, gap in the samples
+  if(adc_hw->fcs & ADC_FCS_OVER_BITS)
+  {
+    adc_overflow_count++;
+    adc_hw->fcs = adc_hw->fcs | ADC_FCS_OVER_BITS;   // write 1 to clear
+  }
   
-  
-  adc_samp_sum[adc_samp_last_block_pos][1] = (int16_t)(((adc_samp[adc_samp_last_block_pos1][4] * 304L) + 
-                                                        (adc_samp[adc_samp_last_block_pos1][7] * 523L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][10] * 897L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][13] * 1366L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][16] * 1901L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][19] * 2454L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][22] * 2972L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][25] * 3394L) +
-                                                        (adc_samp[adc_samp_last_block_pos1][28] * 3671L) +
-                                                        (adc_samp[adc_samp_last_block_pos][1] * 3768L) +
-                                                        (adc_samp[adc_samp_last_block_pos][4] * 3671L) +
-                                                        (adc_samp[adc_samp_last_block_pos][7] * 3394L) +
-                                                        (adc_samp[adc_samp_last_block_pos][10] * 2972L) +
-                                                        (adc_samp[adc_samp_last_block_pos][13] * 2454L) +
-                                                        (adc_samp[adc_samp_last_block_pos][16] * 1901L) +
-                                                        (adc_samp[adc_samp_last_block_pos][19] * 1366L) +
-                                                        (adc_samp[adc_samp_last_block_pos][22] * 897L) +
-                                                        (adc_samp[adc_samp_last_block_pos][25] * 523L) +
-                                                        (adc_samp[adc_samp_last_block_pos][28] * 304L)) >> 13u);  // >>16  *8 to give some gain (on average sum it is *10)
+
+  gpio_set_mask(1<<14);   //GP14
+
+
+
+  //prepare I Q and MIC audio samples
+  //sum last samples to make a low frequency average sample (160kHz to 16kHz sample freq)
+
+
+  // average method used for BIAS:
+  // example:  average result = average value x4 = ave_x4
+  //           ave_x4 += new_value - (ave_x4/4)
+
+
+
+  uint16_t nset = block_nset;       // samples of each channel in the block
+  uint16_t stride = adc_num_ch;     // channels in the round robin
+  uint16_t num_ch = stride;         // channels processed
+#ifndef ADC_RX_IQ_ONLY
+  //MIC is used only on TX and for VOX, skip it on RX
+  if((tx_enabled == false) && (vox_level == VOX_OFF))
+  {
+    num_ch = ADC_NUM_CH-1u;
+  }
+#endif
+  if(num_ch < ADC_NUM_CH)
+  {
+    adc_samp_sum[adc_samp_last_block_pos][ADC_CH_MIC] = 0;
+  }
+
+  //de-interleave the block:  bias removed and one contiguous array for each channel
+  for(uint16_t ch=0; ch<num_ch; ch++)
+  {
+    // the DMA is done with this block, no need of volatile reads
+    const int16_t *src = (const int16_t *)&adc_samp[adc_samp_last_block_pos][ch];
+    int16_t *dst = adc_ch_samp[ch];
+    int16_t bias = (int16_t)(adc_result_bias[ch] >> AVG_BIAS_SHIFT);
+    int32_t sum = 0;
+
+    for(uint16_t n=0; n<nset; n++)
+    {
+      int16_t x = src[n*stride];
+      sum += x;
+      // remove bias (avg) from samples
+      dst[n] = x - bias;
+    }
+    // bias = samples average = DC value from the samples  (it is always positive)
+    // ave_x256 += sum(new_value - ave)  for the block
+    sum -= (int32_t)nset * bias;    // = block sum without bias
+#ifdef BIAS_FREEZE_TX
+    if((tx_enabled == false) || (ch == ADC_CH_MIC))
+#endif
+    {
+      adc_result_bias[ch] += sum;
+    }
+
+#if LOW_PASS_16KHZ == LOW_PASS_16KHZ_AVERAGE_SUM
+    // sum of last 10 samples = all block  (block samples sum to subsample at lower frequency, it is a low pass filter too)
+    if(nset > (BLOCK_NSAMP/ADC_NUM_CH))
+    {
+      sum = (sum * 11) >> 4;   // 15 samples: same gain as 10 samples  (x 0.69)
+    }
+    adc_samp_sum[adc_samp_last_block_pos][ch] = (int16_t)sum;
+#endif
+  }
+
+
+
+
+
+  //pan tuning inside the ADC band: the decimator takes I Q mixed to the tuned freq
+  const int16_t *dec_in[ADC_NUM_CH] = { adc_ch_samp[0], adc_ch_samp[1], adc_ch_samp[2] };
+  if(rx_pan_new)
+  {
+    rx_pan_new = 0;
+    nco_set_freq(&rx_pan_nco, -rx_pan_hz, fsamp_ch);
+  }
+  if(rx_pan_nco.step != 0)
+  {
+    rx_pan_block(nset);
+    dec_in[FFT_CH_RE] = rx_pan_samp[0];
+    dec_in[FFT_CH_IM] = rx_pan_samp[1];
+#if LOW_PASS_16KHZ == LOW_PASS_16KHZ_AVERAGE_SUM
+    for(uint16_t ch=0; ch<2; ch++)
+    {
+      int32_t sum = 0;
+      for(uint16_t n=0; n<nset; n++)
+      {
+        sum += dec_in[ch][n];
+      }
+      if(nset > (BLOCK_NSAMP/ADC_NUM_CH))
+      {
+        sum = (sum * 11) >> 4;
+      }
+      adc_samp_sum[adc_samp_last_block_pos][ch] = (int16_t)sum;
+    }
+#endif
+  }
+
+
+#if LOW_PASS_16KHZ == LOW_PASS_16KHZ_FIR
+
+  for(uint16_t ch=0; ch<num_ch; ch++)
+  {
+    // block to the decimator history, twice (circular with double length = contiguous window)
+    int16_t *h = dec_hist[ch];
+    for(uint16_t n=0; n<nset; n++)
+    {
+      h[dec_hist_pos + n] = h[dec_hist_pos + DEC_HIST_NSAMP + n] = dec_in[ch][n];
+    }
+  }
+  if(stride == ADC_NUM_CH)
+  {
+    // window of the last DEC_LPF_TAP_NUM samples, ending with the last sample of this block
+    uint16_t dec_x = dec_hist_pos + DEC_HIST_NSAMP + nset - DEC_LPF_TAP_NUM;
+
+    adc_samp_sum[adc_samp_last_block_pos][0] = decim_fir<DEC_LPF_TAP_NUM, DEC_SHIFT_IQ>(&dec_hist[0][dec_x], dec_lpf_taps);
+    adc_samp_sum[adc_samp_last_block_pos][1] = decim_fir<DEC_LPF_TAP_NUM, DEC_SHIFT_IQ>(&dec_hist[1][dec_x], dec_lpf_taps);
+    if(num_ch == ADC_NUM_CH)
+    {
+      adc_samp_sum[adc_samp_last_block_pos][ADC_CH_MIC] = decim_fir<DEC_LPF_TAP_NUM, DEC_SHIFT_MIC>(&dec_hist[ADC_CH_MIC][dec_x], dec_lpf_taps);
+    }
+  }
+  else  // I Q only @240kHz
+  {
+    uint16_t dec_x = dec_hist_pos + DEC_HIST_NSAMP + nset - DEC_LPF_240K_TAP_NUM;
+
+    adc_samp_sum[adc_samp_last_block_pos][0] = decim_fir<DEC_LPF_240K_TAP_NUM, DEC_SHIFT_IQ>(&dec_hist[0][dec_x], dec_lpf_240k_taps);
+    adc_samp_sum[adc_samp_last_block_pos][1] = decim_fir<DEC_LPF_240K_TAP_NUM, DEC_SHIFT_IQ>(&dec_hist[1][dec_x], dec_lpf_240k_taps);
+  }
+  dec_hist_pos += nset;
+  if(dec_hist_pos >= DEC_HIST_NSAMP)
+  {
+    dec_hist_pos = 0;
+  }
+
 #endif
 
+#if LOW_PASS_16KHZ == LOW_PASS_16KHZ_CIC
+
+  for(uint16_t ch=0; ch<num_ch; ch++)
+  {
+    // CIC integrators @160kHz
+    uint32_t *integ = cic_integ[ch];
+    for(uint16_t n=0; n<nset; n++)
+    {
+      uint32_t v = (uint32_t)(int32_t)dec_in[ch][n];
+      for(uint16_t k=0; k<CIC_ORDER; k++)
+      {
+        integ[k] += v;
+        v = integ[k];
+      }
+    }
 
+    // CIC combs @16kHz (one output per block = R samples) and compensation FIR
+    uint32_t v = integ[CIC_ORDER-1u];
+    for(uint16_t k=0; k<CIC_ORDER; k++)
+    {
+      uint32_t d = v - cic_comb[ch][k];
+      cic_comb[ch][k] = v;
+      v = d;
+    }
+    cic_comp_hist[ch][cic_comp_pos] = cic_comp_hist[ch][cic_comp_pos + CIC_COMP_TAP_NUM] = (int16_t)((int32_t)v >> cic_shift);
+    adc_samp_sum[adc_samp_last_block_pos][ch] = (int16_t)(fir_sym<CIC_COMP_TAP_NUM>(&cic_comp_hist[ch][cic_comp_pos + 1u], cic_comp_taps) >> CIC_COMP_SHIFT);
+  }
+  cic_comp_pos++;
+  if(cic_comp_pos >= CIC_COMP_TAP_NUM)
+  {
+    cic_comp_pos = 0;
+  }
 
 #endif
 
@@ -1475,7 +2206,7 @@ The sampling is at 160kHz but for audio we only need 16kHz samples, so the filte
 
 
   //choose between 8kHz and 16kHz(or 5333Hz) for audio process
-  if((dsp_mode != MODE_CW) ||  //for SSB and AM  run the audio @ 16kHz
+  if((dsp_mode_p->rx_audio_8k == false) ||  //for SSB and AM  run the audio @ 16kHz
      (tx_enabled == true))     //run CW TX @16kHz  (good for side tone @16kHz with same output audio filter)  
   {
     
@@ -1493,12 +2224,10 @@ The sampling is at 160kHz but for audio we only need 16kHz samples, so the filte
         // result = sum of last samples = average = low pass filter
         // low pass filter with the last samples average    4096 * 10  fits on  16 bits
         // (the signal should have freqs only < 8kHz  for use in the FIR low pass filter @16kHz sample freq)
-        adc_result[0] = adc_samp_sum[adc_samp_last_block_pos][0];   // = 10x input signal, 12bits x 10 = 16bits   (FFF * 10 = 9FF6)
-        adc_result[1] = adc_samp_sum[adc_samp_last_block_pos][1];   // = 10x input signal, 12bits x 10 = 16bits   (FFF * 10 = 9FF6)
-        adc_result[2] = adc_samp_sum[adc_samp_last_block_pos][2] >> 3u;  // /8 instead of /10 = little gain
-      
-        // invoque FIFO IRQ on Core0 to use the adc_result[] audio sample (there is no time for all in one core)
-        multicore_fifo_push_blocking(FIFO_IQ_SAMPLE);    
+        // = 10x input signal, 12bits x 10 = 16bits   (FFF * 10 = 9FF6),  MIC /8 instead of /10 = little gain
+        audio_ring_sample(adc_samp_sum[adc_samp_last_block_pos][0],
+                          adc_samp_sum[adc_samp_last_block_pos][1],
+                          adc_samp_sum[adc_samp_last_block_pos][2] >> 3u);
       }
     }
     else  //RX and not CW, audio = 16kHz
@@ -1506,12 +2235,10 @@ The sampling is at 160kHz but for audio we only need 16kHz samples, so the filte
       // result = sum of last samples = average = low pass filter
       // low pass filter with the last samples average    4096 * 10  fits on  16 bits
       // (the signal should have freqs only < 8kHz  for use in the FIR low pass filter @16kHz sample freq)
-      adc_result[0] = adc_samp_sum[adc_samp_last_block_pos][0];   // = 10x input signal, 12bits x 10 = 16bits   (FFF * 10 = 9FF6)
-      adc_result[1] = adc_samp_sum[adc_samp_last_block_pos][1];   // = 10x input signal, 12bits x 10 = 16bits   (FFF * 10 = 9FF6)
-      adc_result[2] = adc_samp_sum[adc_samp_last_block_pos][2] >> 3u;  // /8 instead of /10 = little gain
-    
-      // invoque FIFO IRQ on Core0 to use the adc_result[] audio sample (there is no time for all in one core)
-      multicore_fifo_push_blocking(FIFO_IQ_SAMPLE);
+      // = 10x input signal, 12bits x 10 = 16bits   (FFF * 10 = 9FF6),  MIC /8 instead of /10 = little gain
+      audio_ring_sample(adc_samp_sum[adc_samp_last_block_pos][0],
+                        adc_samp_sum[adc_samp_last_block_pos][1],
+                        adc_samp_sum[adc_samp_last_block_pos][2] >> 3u);
     }
 
 #endif
@@ -1522,12 +2249,10 @@ The sampling is at 160kHz but for audio we only need 16kHz samples, so the filte
     // result = sum of last samples = average = low pass filter
     // low pass filter with the last samples average    4096 * 10  fits on  16 bits
     // (the signal should have freqs only < 8kHz  for use in the FIR low pass filter @16kHz sample freq)
-    adc_result[0] = adc_samp_sum[adc_samp_last_block_pos][0];   // = 10x input signal, 12bits x 10 = 16bits   (FFF * 10 = 9FF6)
-    adc_result[1] = adc_samp_sum[adc_samp_last_block_pos][1];   // = 10x input signal, 12bits x 10 = 16bits   (FFF * 10 = 9FF6)
-    adc_result[2] = adc_samp_sum[adc_samp_last_block_pos][2] >> 3u;  // /8 instead of /10 = little gain
-  
-    // invoque FIFO IRQ on Core0 to use the adc_result[] audio sample (there is no time for all in one core)
-    multicore_fifo_push_blocking(FIFO_IQ_SAMPLE);
+    // = 10x input signal, 12bits x 10 = 16bits   (FFF * 10 = 9FF6),  MIC /8 instead of /10 = little gain
+    audio_ring_sample(adc_samp_sum[adc_samp_last_block_pos][0],
+                      adc_samp_sum[adc_samp_last_block_pos][1],
+                      adc_samp_sum[adc_samp_last_block_pos][2] >> 3u);
 
 #endif
 
@@ -1537,6 +2262,8 @@ The sampling is at 160kHz but for audio we only need 16kHz samples, so the filte
   
     if(cw_int_count == 0)   //first of two blocks for CW @ 8kHz
     {
+      cw_samp_sum[0] = adc_samp_sum[adc_samp_last_block_pos][0];
+      cw_samp_sum[1] = adc_samp_sum[adc_samp_last_block_pos][1];
       cw_int_count = 1;
     }
     else   //second block for CW @ 8kHz
@@ -1545,11 +2272,11 @@ The sampling is at 160kHz but for audio we only need 16kHz samples, so the filte
       // low pass filter with the last samples average    4096 * 10  fits on  16 bits
 
       // average from last 2 blocks
-      adc_result[0] = (int16_t)((int32_t)(adc_samp_sum[0][0]) + 
-                                (int32_t)(adc_samp_sum[1][0]))>>1;
+      int16_t cw_i = (int16_t)((int32_t)(cw_samp_sum[0]) + 
+                               (int32_t)(adc_samp_sum[adc_samp_last_block_pos][0]))>>1;
       // average from last 2 blocks
-      adc_result[1] = (int16_t)((int32_t)(adc_samp_sum[0][1]) + 
-                                (int32_t)(adc_samp_sum[1][1]))>>1;
+      int16_t cw_q = (int16_t)((int32_t)(cw_samp_sum[1]) + 
+                               (int32_t)(adc_samp_sum[adc_samp_last_block_pos][1]))>>1;
 /*      
       // average from last 4 blocks
       adc_result[0] = (uint16_t)((uint32_t)(adc_samp_sum[0][0]) + 
@@ -1562,10 +2289,8 @@ The sampling is at 160kHz but for audio we only need 16kHz samples, so the filte
                                  (uint32_t)(adc_samp_sum[2][1]) +
                                  (uint32_t)(adc_samp_sum[3][1]))>>2;
 */
-      adc_result[2] = adc_samp_sum[adc_samp_last_block_pos][2] >> 3u;  // /8 instead of /10 = little gain  (mic not used in CW)
-    
-      // invoque FIFO IRQ on Core0 to use the adc_result[] audio sample (there is no time for all in one core)
-      multicore_fifo_push_blocking(FIFO_IQ_SAMPLE); 
+      audio_ring_sample(cw_i, cw_q,
+                        adc_samp_sum[adc_samp_last_block_pos][2] >> 3u);  // /8 instead of /10 = little gain  (mic not used in CW)
   
       cw_int_count = 0;
     }
@@ -1575,46 +2300,34 @@ The sampling is at 160kHz but for audio we only need 16kHz samples, so the filte
 
 
 
-  //collect FFT raw samples
-  if(fft_samples_ready == 0)  //receiving the samples
+  //new zoom: restart the decimator and the FFT samples
+  if(fft_zoom_new)
   {
-    //copy new samples to FFT buffer  (raw adc sample values for FFT)
-    for(i_int=0; i_int<BLOCK_NSAMP; )
-    {  
-      fft_samp[fft_samp_block_pos][i_int] = adc_samp[adc_samp_last_block_pos][i_int];
-      i_int++;
-      fft_samp[fft_samp_block_pos][i_int] = adc_samp[adc_samp_last_block_pos][i_int];
-      i_int++;
-      fft_samp[fft_samp_block_pos][i_int] = adc_samp[adc_samp_last_block_pos][i_int];   // MIC is not necessary, but lets save it too
-      i_int++;
-    }
-    
-    fft_samp_block_pos++;
-    if(fft_samp_block_pos >= FFT_NUM_BLOCK)
-    {
-      fft_samples_ready = 1;
-    }
+    fft_zoom_apply();
   }
-  else if(fft_samples_ready == 1)  //waiting FFT to end
+
+  //save FFT raw samples on the ring, every block  (core1 takes the latest ones for each FFT)
+  if(fft_zoom_shift > 0)
   {
-       //just wait
+    //zoom FFT: mixer and decimator
+    fft_zoom_block(nset);
   }
-  else // fft_samples_ready == 2  ready with graphic
+  else
   {
-    //start filling FFT samples buffer over again
-    fft_samp_block_pos = 0;
-    fft_samples_ready = 0;
+    //copy new samples to FFT ring  (adc sample values without bias for FFT),  MIC is not necessary
+    uint32_t pos = fft_samp_pos;
+    for(uint16_t n=0; n<nset; n++)
+    {  
+      fft_samp[0][(pos + n) & FFT_SAMP_MASK] = adc_ch_samp[0][n];
+      fft_samp[1][(pos + n) & FFT_SAMP_MASK] = adc_ch_samp[1][n];
+    }
+    fft_samp_pos = pos + nset;
   }
 
 
 
 
   //prepare next block position
-#if LOW_PASS_16KHZ == LOW_PASS_16KHZ_FIR  
-  adc_samp_last_block_pos3 = adc_samp_last_block_pos2;  //16kHz LP FIR use one more block
-  adc_samp_last_block_pos2 = adc_samp_last_block_pos1;  //16kHz LP FIR use one more block
-  adc_samp_last_block_pos1 = adc_samp_last_block_pos;  //16kHz LP FIR use one more block
-#endif
   adc_samp_last_block_pos = adc_samp_block_pos;
   adc_samp_block_pos++;   // = avg_num_block_pos;
   adc_samp_block_pos&=ADC_NUM_BLOCK_MASK;
@@ -1643,13 +2356,14 @@ The sampling is at 160kHz but for audio we only need 16kHz samples, so the filte
 
 /************************************************************************************** 
  * CORE0:  FIFO IRQ
- * FIFO IRQ handler - IRQ when FIFO push from Core1
- * in worst case, it takes < 54us (1/16kHz = 62.5us)  **  caution to include more code
+ * FIFO IRQ handler - IRQ when FIFO push from Core1 = AUDIO_BLOCK_NSAMP new samples in the input ring
+ * in worst case, it takes < 54us per sample (1/16kHz = 62.5us)  **  caution to include more code
  * 
  **************************************************************************************/
 // 
 void core0_irq_handler() 
 {
+  uint32_t tail, head;
             
   gpio_set_mask(1<<LED_BUILTIN);
 
@@ -1665,39 +2379,68 @@ void core0_irq_handler()
   if(multicore_fifo_rvalid()) 
   {
     // pop the data from FIFO stack
-    (void)multicore_fifo_pop_blocking();
+    while(multicore_fifo_rvalid())
+    {
+      (void)multicore_fifo_pop_blocking();
+    }
 
 
     //run the application for vox, rx and tx here in the irq
     //it must be treated as soon as possible
-  
-    //use audio samples
-    //tx_enabled = ptt_active || vox();  // Sample audio and check level - watch out - this way it does not run vox() if ptt_active is true
-    tx_enabled = vox();     // Sample audio and check level 
-    tx_enabled |= ptt_active;     //tx_enabled is used at next DMA int
-  
-    if (tx_enabled)
+    //process all samples available in the input ring
+    tail = audio_in_tail;
+    head = audio_in_head;
+    __dmb();                      // head read before the samples
+    for(; tail != head; tail++)
     {
-      if (vox_level != VOX_OFF)       // vox enabled with some level
+      //use audio samples
+      adc_result[0] = audio_in[tail & AUDIO_RING_MASK][0];
+      adc_result[1] = audio_in[tail & AUDIO_RING_MASK][1];
+      adc_result[2] = audio_in[tail & AUDIO_RING_MASK][2];
+      __dmb();
+      audio_in_tail = tail + 1u;  // free the input position
+
+      //tx_enabled = ptt_active || vox();  // Sample audio and check level - watch out - this way it does not run vox() if ptt_active is true
+      tx_enabled = vox();     // Sample audio and check level 
+      tx_enabled |= ptt_active;     //tx_enabled is used at next DMA int
+    
+      if (tx_enabled)
       {
-        //set PTT as output ??
-        gpio_put(GP_PTT, false);      //drive PTT low (active)
-      }
+        if (vox_level != VOX_OFF)       // vox enabled with some level
+        {
+          //set PTT as output ??
+          gpio_put(GP_PTT, false);      //drive PTT low (active)
+        }
 #if TX_METHOD == PHASE_AMPLITUDE    // uSDX TX method used for Class E RF amplifier
-      uSDX_TX_PhaseAmpl();
+        uSDX_TX_PhaseAmpl();
 #endif
 #if TX_METHOD == I_Q_QSE 
-      tx();
+        tx();
 #endif
-    }
-    else
-    {
-      if (vox_level != VOX_OFF)         // vox enabled with some level
+      }
+      else
+      {
+        if (vox_level != VOX_OFF)         // vox enabled with some level
+        {
+          //set PTT as input ??
+          gpio_put(GP_PTT, true);       //     drive PTT high (inactive)
+        }
+        rx();
+      }
+
+      //output levels to the output ring, core1 plays them AUDIO_OUT_PREFILL samples later
+      if((audio_out_head - audio_out_tail) < AUDIO_RING_NSAMP)
+      {
+        audio_out[audio_out_head & AUDIO_RING_MASK][AUDIO_OUT_AUD] = dac_audio_level;
+        audio_out[audio_out_head & AUDIO_RING_MASK][AUDIO_OUT_I] = dac_i_level;
+        audio_out[audio_out_head & AUDIO_RING_MASK][AUDIO_OUT_Q] = dac_q_level;
+        __dmb();                  // levels written before the new head is seen by core1
+        audio_out_head++;
+      }
+      else
       {
-        //set PTT as input ??
-        gpio_put(GP_PTT, true);       //     drive PTT high (inactive)
+        audio_out_overrun_count++;
       }
-      rx();
     }
 
   }
@@ -1726,7 +2469,234 @@ void core0_irq_handler()
  * No ADC sample interleaving, read both I and Q channels.
  * The delay is only 2us per conversion, which causes less distortion than interpolation of samples.
  **************************************************************************************/
-volatile int16_t i_s[HILBERT_TAP_NUM], q_s[HILBERT_TAP_NUM];					// Filtered I/Q samples
+int16_t i_s[2*HILBERT_TAP_NUM], q_s[2*HILBERT_TAP_NUM];					// Filtered I/Q samples, circular double length as the raw samples
+
+/* 
+ * Qh is Classic Hilbert transform 15 taps, 12 bits (see Iowa Hills calculator)
+ * w[0] oldest, w[7] = middle = same delay as the other channel
+ */
+static inline int16_t hilbert_15(const int16_t *w)
+{
+  int32_t accu;
+
+  accu = (w[0]-w[14])*315L + (w[2]-w[12])*440L + (w[4]-w[10])*734L + (w[6]-w[ 8])*2202L;
+  return (int16_t)(accu >> 12);  // / 4096L;
+}
+
+/* USB demodulate: I[7] - Qh */
+static int16_t demod_usb(const int16_t *iw, const int16_t *qw)
+{
+  return iw[7] - hilbert_15(qw);  // 7 = (HILBERT_TAP_NUM-1)/2
+}
+
+/* LSB demodulate: I[7] + Qh   (also RX CW) */
+static int16_t demod_lsb(const int16_t *iw, const int16_t *qw)
+{
+  return iw[7] + hilbert_15(qw);  // 7 = (HILBERT_TAP_NUM-1)/2
+}
+
+/* AM demodulate: sqrt(sqr(i)+sqr(q)), approximated with MAG(i,q) of the last filtered I Q sample */
+static int16_t demod_am(const int16_t *iw, const int16_t *qw)
+{
+  return MAG(iw[(HILBERT_TAP_NUM-1)], qw[(HILBERT_TAP_NUM-1)]);
+}
+
+/*
+ * SAM = synchronous AM:  PLL locked on the carrier of the filtered I Q, I Q derotated by the PLL phase
+ * the carrier goes to the real axis = the audio (+ carrier DC, as AM) is on I, the quadrature error on Q
+ * phase detector: derotated Q normalized by the carrier level with a shift (log2, no division)
+ *   err = Q / carrier  in Q14  (= phase error in rad x 2^14, x1 to x2 from the log2)
+ * PI loop:  freq += err << KI,  step = freq + (err << KP)   ~50Hz loop bandwidth @16kHz,  lock range +-SAM_FREQ_MAX_HZ
+ * sin cos from the NCO table (nco.h), DSB = derotated I,  USB LSB = I -+ Hilbert(Q) of the derotated window
+ */
+#define SAM_KP_SHIFT        10
+#define SAM_KI_SHIFT        4
+#define SAM_CARRIER_SHIFT   5      // carrier level average, 32 samples
+#define SAM_FREQ_MAX_HZ     1000
+#define SAM_FREQ_MAX        ((int32_t)(((int64_t)SAM_FREQ_MAX_HZ << 32) / FSAMP_AUDIO))
+nco_t sam_nco;
+volatile int32_t sam_freq = 0;     // PLL freq, same units as the NCO step
+int32_t sam_carrier = 0;           // derotated I average, Q15 scaled
+int16_t sam_i[2*HILBERT_TAP_NUM], sam_q[2*HILBERT_TAP_NUM];   // derotated I Q, circular double length as i_s[] q_s[]
+uint16_t sam_pos = 0;
+
+static inline void sam_pll(const int16_t *iw, const int16_t *qw)
+{
+  int16_t c, s;
+  int32_t i = iw[(HILBERT_TAP_NUM-1)];
+  int32_t q = qw[(HILBERT_TAP_NUM-1)];
+  int32_t yi, yq, err;
+  int16_t n;
+
+  nco_next(&sam_nco, &c, &s);
+  yi = i * c + q * s;          // (i + jq) * e^-j(phase),  Q15 scaled
+  yq = q * c - i * s;
+
+  sam_carrier += (yi - sam_carrier) >> SAM_CARRIER_SHIFT;
+  n = 31 - __builtin_clz((uint32_t)MAX(sam_carrier, (int32_t)(1 << 15)));   // log2(carrier), carrier >= 1
+  err = yq >> (n - 14);
+  if(err > (1 << 14))          // +-1 rad, no big kicks when unlocked
+  {
+    err = (1 << 14);
+  }
+  else if(err < -(1 << 14))
+  {
+    err = -(1 << 14);
+  }
+
+  sam_freq += err << SAM_KI_SHIFT;
+  if(sam_freq > SAM_FREQ_MAX)
+  {
+    sam_freq = SAM_FREQ_MAX;
+  }
+  else if(sam_freq < -SAM_FREQ_MAX)
+  {
+    sam_freq = -SAM_FREQ_MAX;
+  }
+  sam_nco.step = (uint32_t)(sam_freq + (err << SAM_KP_SHIFT));
+
+  if(++sam_pos >= HILBERT_TAP_NUM)
+  {
+    sam_pos = 0;
+  }
+  sam_i[sam_pos] = sam_i[sam_pos + HILBERT_TAP_NUM] = (int16_t)(yi >> 15);
+  sam_q[sam_pos] = sam_q[sam_pos + HILBERT_TAP_NUM] = (int16_t)(yq >> 15);
+}
+
+/* SAM demodulate: derotated I of the last sample (both sidebands) */
+static int16_t demod_sam(const int16_t *iw, const int16_t *qw)
+{
+  sam_pll(iw, qw);
+  return sam_i[sam_pos + HILBERT_TAP_NUM];
+}
+
+/* SAM USB: derotated I[7] - Qh  (the carrier PLL keeps the audio on tune, only the upper sideband) */
+static int16_t demod_sam_usb(const int16_t *iw, const int16_t *qw)
+{
+  sam_pll(iw, qw);
+  return sam_i[sam_pos + 1u + 7u] - hilbert_15(&sam_q[sam_pos + 1u]);  // [0] oldest
+}
+
+/* SAM LSB: derotated I[7] + Qh */
+static int16_t demod_sam_lsb(const int16_t *iw, const int16_t *qw)
+{
+  sam_pll(iw, qw);
+  return sam_i[sam_pos + 1u + 7u] + hilbert_15(&sam_q[sam_pos + 1u]);
+}
+
+/* SAM carrier offset from the tuned freq */
+int32_t dsp_sam_offset_hz(void)
+{
+  return((int32_t)(((int64_t)sam_freq * FSAMP_AUDIO) >> 32));
+}
+
+/*
+ * NBFM:  discriminator = phase difference of two filtered I Q samples, phase from atan2 (table + linear interpolation)
+ * angles in int16: 65536 = 2pi, the difference wraps by itself  (2.5kHz deviation = 10240 @16kHz)
+ * de-emphasis: one pole low pass @318Hz (-6dB/octave),  audio volume = rx_gain on the output only
+ *   (no AGC and no rx_gain on the FM input: the discriminator does not depend on the level)
+ * squelch: level of the noise above the voice (second difference of the discriminator, 32 samples average)
+ *   closes when noise > threshold,  opens when noise < 3/4 threshold
+ */
+#define ATAN_LUT_SHIFT    6
+static const int16_t atan_lut[(1 << ATAN_LUT_SHIFT) + 1] = {    // atan(k/64) in 65536 = 2pi,  0 - 45 degrees
+     0,  163,  326,  489,  651,  813,  975, 1136, 1297, 1457, 1617, 1775, 1933, 2090, 2246, 2401,
+  2555, 2708, 2860, 3010, 3159, 3307, 3453, 3599, 3742, 3884, 4025, 4164, 4302, 4438, 4572, 4705,
+  4836, 4966, 5094, 5220, 5344, 5467, 5589, 5708, 5826, 5943, 6058, 6171, 6282, 6392, 6500, 6607,
+  6712, 6815, 6917, 7018, 7117, 7214, 7310, 7405, 7498, 7589, 7679, 7768, 7856, 7942, 8026, 8110,
+  8192
+};
+#define FM_DEEMPH_SHIFT   3      // 16kHz / (2pi x 8) = 318Hz
+#define FM_NOISE_SHIFT    5
+#define FM_OUT_MUL        25     // 20480 (FM_DEV_MAX_HZ) x 16 (rx_gain max) x 25 >> 16 = 125 = DAC range
+#define FM_OUT_SHIFT      16
+#define FM_SQL_STEP       4000   // threshold = (10 - level) x step,  no signal = ~37000
+volatile uint16_t fm_squelch = FM_SQL_DEFAULT;    // 0 = open, 1 - 9
+volatile int32_t fm_noise = 0;
+bool fm_sql_open = true;
+int16_t fm_ang_prev = 0;
+int16_t fm_d1 = 0, fm_d2 = 0;    // last discriminator outputs
+int32_t fm_deemph = 0;
+
+/* phase of x + jy,  65536 = 2pi  (the divider of the RP2040 takes 8 cycles) */
+static inline int16_t atan2_q16(int32_t y, int32_t x)
+{
+  uint32_t ax = ABS(x);
+  uint32_t ay = ABS(y);
+  uint32_t r, k;
+  int32_t a;
+
+  if((ax | ay) == 0)
+  {
+    return(0);
+  }
+  if(ay <= ax)
+  {
+    r = (ay << 12) / ax;         // tan 0 - 1 in 2^12
+  }
+  else
+  {
+    r = (ax << 12) / ay;
+  }
+  k = r >> ATAN_LUT_SHIFT;
+  a = atan_lut[k];
+  if(k < (1u << ATAN_LUT_SHIFT))   // linear interpolation
+  {
+    a += ((atan_lut[k + 1] - atan_lut[k]) * (int32_t)(r & ((1u << ATAN_LUT_SHIFT) - 1u))) >> ATAN_LUT_SHIFT;
+  }
+  if(ay > ax)
+  {
+    a = 16384 - a;               // 45 - 90 degrees
+  }
+  if(x < 0)
+  {
+    a = 32768 - a;
+  }
+  if(y < 0)
+  {
+    a = -a;
+  }
+  return((int16_t)a);
+}
+
+/* FM demodulate: phase difference of the last two samples, de-emphasis and squelch */
+static int16_t demod_fm(const int16_t *iw, const int16_t *qw)
+{
+  int16_t ang = atan2_q16(qw[(HILBERT_TAP_NUM-1)], iw[(HILBERT_TAP_NUM-1)]);
+  int16_t d = (int16_t)(ang - fm_ang_prev);
+  int32_t hp = (int32_t)d - 2*(int32_t)fm_d1 + (int32_t)fm_d2;    // high pass: noise above the voice
+  int32_t th;
+
+  fm_ang_prev = ang;
+  fm_d2 = fm_d1;
+  fm_d1 = d;
+  fm_noise += (ABS(hp) - fm_noise) >> FM_NOISE_SHIFT;
+  fm_deemph += ((int32_t)d - fm_deemph) >> FM_DEEMPH_SHIFT;
+
+  if(fm_squelch == 0)
+  {
+    fm_sql_open = true;
+  }
+  else
+  {
+    th = (int32_t)(10u - fm_squelch) * FM_SQL_STEP;
+    if(fm_noise > th)
+    {
+      fm_sql_open = false;
+    }
+    else if(fm_noise < ((th * 3) >> 2))
+    {
+      fm_sql_open = true;
+    }
+  }
+  if(fm_sql_open == false)
+  {
+    return(0);
+  }
+  return((int16_t)((fm_deemph * (int32_t)rx_gain * FM_OUT_MUL) >> FM_OUT_SHIFT));
+}
+
+uint16_t iq_s_pos = 0;
 volatile int16_t i_dc, q_dc; 						// DC bias for I/Q channel
 //bool rx() __attribute__ ((section (".scratch_x.")));
 volatile int16_t q_sample, i_sample, a_sample;
@@ -1734,9 +2704,11 @@ bool rx(void)
 {
   int16_t out_sample;
 	int32_t q_accu, i_accu;
-	int16_t qh;
 	uint16_t i;
 	uint16_t k;
+  int16_t *iw, *qw;           // contiguous windows over the delay lines, [0] = oldest
+  const dsp_mode_t *m = dsp_mode_p;    // same mode for the whole sample
+  int32_t in_gain;
 
 //  gpio_set_mask(1<<LED_BUILTIN);
 
@@ -1746,52 +2718,69 @@ bool rx(void)
 	 * Attenuate with AGC feedback from AUDIO GENERATION stage
 	 * This behavior in essence is exponential, complementing the logarithmic peak detector
 	 */
+  in_gain = (m->agc) ? (int32_t)(agc_gain * rx_gain) : (int32_t)(AGC_GAIN_MAX << RX_GAIN_SHIFT);   // FM: full input, volume on the demod output
 #ifdef EXCHANGE_I_Q
   // Take last ADC 0 result, connected to Q input  (16 bits size)
-  i_sample = ((int32_t)(agc_gain * fft_gain) * (int32_t)adc_result[0])>>(AGC_GAIN_SHIFT + FFT_GAIN_SHIFT);
+  i_sample = (in_gain * (int32_t)adc_result[0])>>(AGC_GAIN_SHIFT + RX_GAIN_SHIFT);
   // Take last ADC 1 result, connected to I input  (16 bits size)
-  q_sample = ((int32_t)(agc_gain * fft_gain) * (int32_t)adc_result[1])>>(AGC_GAIN_SHIFT + FFT_GAIN_SHIFT);
+  q_sample = (in_gain * (int32_t)adc_result[1])>>(AGC_GAIN_SHIFT + RX_GAIN_SHIFT);
 #else
   // Take last ADC 0 result, connected to Q input  (16 bits size)
-  q_sample = ((int32_t)(agc_gain * fft_gain) * (int32_t)adc_result[0])>>(AGC_GAIN_SHIFT + FFT_GAIN_SHIFT);
+  q_sample = (in_gain * (int32_t)adc_result[0])>>(AGC_GAIN_SHIFT + RX_GAIN_SHIFT);
   // Take last ADC 1 result, connected to I input  (16 bits size)
-  i_sample = ((int32_t)(agc_gain * fft_gain) * (int32_t)adc_result[1])>>(AGC_GAIN_SHIFT + FFT_GAIN_SHIFT);
+  i_sample = (in_gain * (int32_t)adc_result[1])>>(AGC_GAIN_SHIFT + RX_GAIN_SHIFT);
 #endif
 
+  /*
+   * fine tuning + RIT + IF shift: RX freq to -ifs before the mode filter
+   */
+  if(rx_nco_pre.step != 0)
+  {
+    int16_t re = i_sample;
+    int16_t im = q_sample;
+    nco_mix(&rx_nco_pre, &re, &im);
+    i_sample = re;
+    q_sample = im;
+  }
+
   /*
    * IIR filter: dc = a*sample + (1-a)*dc  where a = 1/128
    * Amplitude of samples should fit inside [-2048, 2047]
    */
   /* 
-   * Shift-in I and Q raw samples 
+   * Store I and Q raw samples in the circular delay lines (twice)
    */
-  for (i=0; i<(mode_filter_tap_num-1u); i++)
+  if(++iq_s_raw_pos >= MAX_TAP_NUM)
   {
-    q_s_raw[i] = q_s_raw[i+1];          // Q raw samples shift register
-    i_s_raw[i] = i_s_raw[i+1];          // I raw samples shift register
+    iq_s_raw_pos = 0;
   }
-  q_s_raw[(mode_filter_tap_num-1u)] = q_sample;              // Store in shift registers
-  i_s_raw[(mode_filter_tap_num-1u)] = i_sample;
+  q_s_raw[iq_s_raw_pos] = q_s_raw[iq_s_raw_pos + MAX_TAP_NUM] = q_sample;
+  i_s_raw[iq_s_raw_pos] = i_s_raw[iq_s_raw_pos + MAX_TAP_NUM] = i_sample;
+  qw = &q_s_raw[iq_s_raw_pos + MAX_TAP_NUM + 1u - m->filter_tap_num];
+  iw = &i_s_raw[iq_s_raw_pos + MAX_TAP_NUM + 1u - m->filter_tap_num];
 
 
-  q_accu = 0;                   // Initialize accumulators
-  i_accu = 0;
-  for (i=0; i<mode_filter_tap_num; i++)             // Low pass FIR filter
-  {
-    q_accu += (int32_t)q_s_raw[i]*mode_filter_taps[i];
-    i_accu += (int32_t)i_s_raw[i]*mode_filter_taps[i];
-  }
+  m->fir_iq(iw, qw, m->filter_taps, &i_accu, &q_accu);     // Low pass FIR filter, folded symmetric taps
   q_accu = q_accu >> FILTER_SHIFT;
   i_accu = i_accu >> FILTER_SHIFT;
 
+  if(rx_nco_post.step != 0)      // IF shift: back to 0Hz, the passband stays moved
+  {
+    int16_t re = i_accu;
+    int16_t im = q_accu;
+    nco_mix(&rx_nco_post, &re, &im);
+    i_accu = re;
+    q_accu = im;
+  }
 
-  for (i=0; i<(HILBERT_TAP_NUM-1u); i++)               // Shift decimated samples
+  if(++iq_s_pos >= HILBERT_TAP_NUM)      // Store filtered samples, circular
   {
-    q_s[i] = q_s[i+1];
-    i_s[i] = i_s[i+1];
+    iq_s_pos = 0;
   }
-	q_s[(HILBERT_TAP_NUM-1u)] = q_accu;
-	i_s[(HILBERT_TAP_NUM-1u)] = i_accu;
+	q_s[iq_s_pos] = q_s[iq_s_pos + HILBERT_TAP_NUM] = q_accu;
+	i_s[iq_s_pos] = i_s[iq_s_pos + HILBERT_TAP_NUM] = i_accu;
+  qw = &q_s[iq_s_pos + 1u];      // [0] oldest  [HILBERT_TAP_NUM-1] newest
+  iw = &i_s[iq_s_pos + 1u];
 
 
 if(aud_samples_state == AUD_STATE_SAMP_IN)    //store variables for scope graphic
@@ -1802,46 +2791,7 @@ if(aud_samples_state == AUD_STATE_SAMP_IN)    //store variables for scope graphi
 
 
 	/*** DEMODULATION ***/
-  //MODE_USB=0 MODE_LSB=1  MODE_AM=2  MODE_CW=3
-	switch (dsp_mode)
-	{
-	case MODE_USB:											//USB
-		/* 
-		 * USB demodulate: I[7] - Qh,
-		 * Qh is Classic Hilbert transform 15 taps, 12 bits (see Iowa Hills calculator)
-		 */	
-		q_accu = (q_s[0]-q_s[14])*315L + (q_s[2]-q_s[12])*440L + (q_s[4]-q_s[10])*734L + (q_s[6]-q_s[ 8])*2202L;
-		qh = q_accu >> 12;  // / 4096L;	
-		a_sample = i_s[7] - qh;  // 7 = (HILBERT_TAP_NUM-1)/2
-		break;
-	case MODE_LSB:											//LSB
-		/* 
-		 * LSB demodulate: I[7] + Qh,
-		 * Qh is Classic Hilbert transform 15 taps, 12 bits (see Iowa Hills calculator)
-		 */	
-		q_accu = (q_s[0]-q_s[14])*315L + (q_s[2]-q_s[12])*440L + (q_s[4]-q_s[10])*734L + (q_s[6]-q_s[ 8])*2202L;
-		qh = q_accu >> 12;  // / 4096L;	
-		a_sample = i_s[7] + qh;  // 7 = (HILBERT_TAP_NUM-1)/2
-		break;
-	case MODE_AM:											//AM
-		/*
-		 * AM demodulate: sqrt(sqr(i)+sqr(q))
-		 * Approximated with MAG(i,q)
-		 */
-		a_sample = MAG(i_s[(HILBERT_TAP_NUM-1)], q_s[(HILBERT_TAP_NUM-1)]);  //MAG from the last filtered I Q sample
-    //a_sample = i_sample;  //MAG from the last filtered I Q sample
-		break;
-  case MODE_CW:                     // CW
-    /*
-     * Rx CW = LSB
-     */	
-    q_accu = (q_s[0]-q_s[14])*315L + (q_s[2]-q_s[12])*440L + (q_s[4]-q_s[10])*734L + (q_s[6]-q_s[ 8])*2202L;
-    qh = q_accu >> 12;  // / 4096L;  
-    a_sample = i_s[7] + qh;  // 7 = (HILBERT_TAP_NUM-1)/2     
-    break;
-  default:
-		break;
-	}
+  a_sample = m->demod(iw, qw);
 
 
 
@@ -1866,7 +2816,12 @@ if(aud_samples_state == AUD_STATE_SAMP_IN)    //store variables for scope graphi
   }
   peak_avg_diff_accu += (k - AGC_REF);            // Add difference with target to integrator (Acc += Xn - R)  AGC_REF=6
  
-	if (peak_avg_diff_accu > agc_attack)						// Attack time, gain correction in case of high level
+  if (m->agc == false)        // FM: input at full gain
+  {
+    agc_gain = AGC_GAIN_MAX;
+    peak_avg_diff_accu = 0;
+  }
+	else if (peak_avg_diff_accu > agc_attack)						// Attack time, gain correction in case of high level
 	{
     if(agc_gain>AGC_GAIN_STEP)
     {
@@ -1902,7 +2857,7 @@ if(aud_samples_state == AUD_STATE_SAMP_IN)    //store variables for scope graphi
 	else if (out_sample<0)
 		out_sample = 0;
 
-  pwm_set_chan_level(dac_audio, PWM_CHAN_A, out_sample);
+  dac_audio_level = out_sample;     // played by core1 one block later
 
 
 #if 0
@@ -1991,7 +2946,8 @@ int16_t compress(int16_t mic_sample)
  * Execute TX branch signal processing when tx enabled
  **************************************************************************************/
 volatile int16_t a_level=0;							// Average level of raw sample stream
-volatile int16_t a_s[HILBERT_TAP_NUM];							// Filtered and decimated samples
+int16_t a_s[2*HILBERT_TAP_NUM];							// Filtered and decimated samples, circular double length
+uint16_t a_s_pos = 0;
 volatile int16_t a_dc;								// DC level
 //volatile int tx_cnt=0;								// Decimation counter
 //bool vox() __attribute__ ((section (".scratch_x.")));
@@ -2023,12 +2979,12 @@ bool vox(void)
 	 * Store new raw sample
 	 * IIR filter: dc = a*sample + (1-a)*dc  where a = 1/128
 	 */
-	for (i=0; i<(mode_filter_tap_num-1u); i++) 							//   and store in shift register
-		a_s_raw[i] = a_s_raw[i+1];
-	a_s_raw[mode_filter_tap_num-1u] = vox_sample;
+	if (++a_s_raw_pos >= MAX_TAP_NUM)					//   and store in circular delay line (twice)
+		a_s_raw_pos = 0;
+	a_s_raw[a_s_raw_pos] = a_s_raw[a_s_raw_pos + MAX_TAP_NUM] = vox_sample;
 
 
-  if(dsp_mode != MODE_CW)   //no vox at CW
+  if(dsp_mode_p->vox)   //no vox at CW
   {
   	/*
   	 * Detect level of audio signal
@@ -2077,88 +3033,132 @@ int16_t cw_tone_to_play[CW_TONE_NUM] = {0, 518, 1000, 1414, 1732, 1932, 2000, 19
 // max -2000 to 2000     to fit at 255  ->  cw_tone_to_play[] >> 4  (the filter makes << 4)
 //int16_t cw_tone_to_play[CW_TONE_NUM] = {0, 31, 60, 85, 104, 116, 120, 116, 104, 85, 60, 31, 0, -31, -60, -85, -104, -116, -120, -116, -104,  -85,  -60,  -31};
 
-/************************************************************************************** 
- * CORE0: inside DMA IRQ
- * Tx 
- **************************************************************************************/
+/* USB:  I = A[7]  Q = -Ah */
+static void mod_usb(const int16_t *aw, int16_t *ih, int16_t *qh)
+{
+  *qh = -hilbert_15(aw);    // USB: sign is negative
+  *ih = aw[7];
+}
+
+/* LSB:  I = A[7]  Q = Ah */
+static void mod_lsb(const int16_t *aw, int16_t *ih, int16_t *qh)
+{
+  *qh = hilbert_15(aw);     // LSB: sign is positive
+  *ih = aw[7];
+}
+
+/* AM:  I and Q values are identical */
+static void mod_am(const int16_t *aw, int16_t *ih, int16_t *qh)
+{
+  *qh = aw[7];
+  *ih = aw[7];
+}
+
+/*
+ * FM:  MIC with pre-emphasis (+6dB/octave over ~300Hz), limited to +-FM_MIC_MAX = max deviation
+ * NCO step = deviation, I Q = constant level e^-j(phase)  (positive freq on TX, as mod_usb)
+ */
+#define FM_PREEMPH_SHIFT  3          // x + 8 (x - x_prev):  corner 16kHz / (2pi x 8) = 318Hz
+#define FM_MIC_SHIFT      11
+#define FM_MIC_MAX        (1 << FM_MIC_SHIFT)
+#define FM_TX_LEVEL       2000       // as the CW tone, 4096 range
+nco_t tx_fm_nco;
+int16_t fm_pre_prev = 0;
+volatile uint32_t fm_dev_k = (uint32_t)(((uint64_t)FM_DEV_DEFAULT_HZ << (32 - FM_MIC_SHIFT)) / FSAMP_AUDIO);   // NCO step for one MIC unit
+volatile uint16_t fm_dev_hz = FM_DEV_DEFAULT_HZ;
+
+static void mod_fm(const int16_t *aw, int16_t *ih, int16_t *qh)
+{
+  int16_t c, s;
+  int32_t a = aw[(HILBERT_TAP_NUM-1)];
+  int32_t x;
+
+  x = a + ((a - fm_pre_prev) << FM_PREEMPH_SHIFT);
+  fm_pre_prev = a;
+  if(x > FM_MIC_MAX)              // deviation limiter
+  {
+    x = FM_MIC_MAX;
+  }
+  else if(x < -FM_MIC_MAX)
+  {
+    x = -FM_MIC_MAX;
+  }
+  tx_fm_nco.step = (uint32_t)(x * (int32_t)fm_dev_k);
+  nco_next(&tx_fm_nco, &c, &s);
+  *ih = (int16_t)(((int32_t)c * FM_TX_LEVEL) >> 15);
+  *qh = (int16_t)(-(((int32_t)s * FM_TX_LEVEL) >> 15));
+}
+
+/* CW:  I Q = tone, 90 degrees apart  (MIC not used),  side tone on the audio */
+static void mod_cw(const int16_t *aw, int16_t *ih, int16_t *qh)
+{
+  int16_t i;
+
+  cw_tone_to_play_pos++;
+  if(cw_tone_to_play_pos >= CW_TONE_NUM)
+  {
+    cw_tone_to_play_pos = 0;
+  }
+  *qh = cw_tone_to_play[cw_tone_to_play_pos];  //it uses a 4096 range, similar to the filters output (it makes >>4 below)
+  i = cw_tone_to_play_pos + (CW_TONE_NUM/4);  // 90 degrees
+  if(i >= CW_TONE_NUM)
+  {
+    i -= CW_TONE_NUM;
+  }
+  *ih = cw_tone_to_play[i]; //it uses a 4096 range, similar to the filters output (it makes >>4 below)
+
+  //audio side tone
+  dac_audio_level = (cw_tone_to_play[cw_tone_to_play_pos]>>6)+DAC_BIAS;  //>>4 = max value, more >>2 to attenuate the side tone sound level
+}
+
+
+
+/************************************************************************************** 
+ * CORE0: inside DMA IRQ
+ * Tx 
+ **************************************************************************************/
 //bool tx() __attribute__ ((section (".scratch_x.")));
 bool tx(void) 
 {
-  int32_t a_accu, q_accu;
+  int32_t a_accu;
   int16_t qh=0;
-  uint i;
+  int16_t ih=0;
+  int16_t *aw;
   uint16_t i_dac, q_dac;
+  const dsp_mode_t *m = dsp_mode_p;    // same mode for the whole sample
     
   /*** RAW Audio SAMPLES from VOX function ***/
   /*** Low pass filter ***/
 
-  //MODE_USB=0 MODE_LSB=1  MODE_AM=2  MODE_CW=3
-  if(dsp_mode != MODE_CW)  //no filter for CW  - direct generated
+  if(m->tx_filter)  //no filter for CW  - direct generated
   {
     //sample already saved at a_s_raw[] in vox()
-    a_accu = 0;                   // Initialize accumulator
-    for (i=0; i<mode_filter_tap_num; i++)              // Low pass FIR filter, using raw samples
-      a_accu += (int32_t)a_s_raw[i]*mode_filter_taps[i];    
-    for (i=0; i<(HILBERT_TAP_NUM-1); i++)              // Shift decimated samples
-      a_s[i] = a_s[i+1];
-    a_s[(HILBERT_TAP_NUM-1)] = (a_accu >> FILTER_SHIFT);             // Store rescaled accumulator
+    aw = &a_s_raw[a_s_raw_pos + MAX_TAP_NUM + 1u - m->filter_tap_num];
+    a_accu = m->fir(aw, m->filter_taps);           // Low pass FIR filter, using raw samples, folded symmetric taps
+    if (++a_s_pos >= HILBERT_TAP_NUM)                 // Store rescaled accumulator, circular
+      a_s_pos = 0;
+    a_s[a_s_pos] = a_s[a_s_pos + HILBERT_TAP_NUM] = (a_accu >> FILTER_SHIFT);
   }
+  aw = &a_s[a_s_pos + 1u];      // [0] oldest  [HILBERT_TAP_NUM-1] newest
 
 
 	/*** MODULATION ***/
-  //mode_USB=0 mode_LSB=1  mode_AM=2  mode_CW=3
-	switch (dsp_mode)
-	{
-	case MODE_USB:											// USB
-		/* 
-		 * qh is Classic Hilbert transform 15 taps, 12 bits (see Iowa Hills calculator)
-		 */	
-		q_accu = (a_s[0]-a_s[14])*315L + (a_s[2]-a_s[12])*440L + (a_s[4]-a_s[10])*734L + (a_s[6]-a_s[ 8])*2202L;
-		qh = -(q_accu >> 12);   // / 4096L; 						// USB: sign is negative
-		break;
-	case MODE_LSB:											// LSB
-		/* 
-		 * qh is Classic Hilbert transform 15 taps, 12 bits (see Iowa Hills calculator)
-		 */	
-		q_accu = (a_s[0]-a_s[14])*315L + (a_s[2]-a_s[12])*440L + (a_s[4]-a_s[10])*734L + (a_s[6]-a_s[ 8])*2202L;
-		qh = (q_accu >> 12);     // / 4096L; 						// LSB: sign is positive
-		break;
-	case MODE_AM:											// AM
-		/*
-		 * I and Q values are identical
-		 */
-		qh = a_s[7];
-		break;
-  case MODE_CW:                     // CW
-    /*
-     * Tx CW I=0 Q=tone
-     */
-    cw_tone_to_play_pos++;
-    if(cw_tone_to_play_pos >= CW_TONE_NUM)
-    {
-      cw_tone_to_play_pos = 0;
-    }
-    qh = cw_tone_to_play[cw_tone_to_play_pos];  //it uses a 4096 range, similar to the filters output (it makes >>4 below)
-    i = cw_tone_to_play_pos + (CW_TONE_NUM/4);  // 90 degrees
-    if(i >= CW_TONE_NUM)
-    {
-      i -= CW_TONE_NUM;
-    }
-    a_s[7] = cw_tone_to_play[i]; //it uses a 4096 range, similar to the filters output (it makes >>4 below)
-
-    //audio side tone
-    pwm_set_chan_level(dac_audio, PWM_CHAN_A, (cw_tone_to_play[cw_tone_to_play_pos]>>6)+DAC_BIAS);  //>>4 = max value, more >>2 to attenuate the side tone sound level
-    //pwm_set_chan_level(dac_audio, PWM_CHAN_A, ((a_s_raw[mode_filter_tap_num-1u]>>4)+DAC_BIAS));  //>>4 = max value, more >>2 to attenuate the side tone sound level
-    break;
-	default:
-		break;
-	}
+  m->mod(aw, &ih, &qh);
+  if(tx_nco.step != 0)     // fine tuning + XIT
+  {
+    nco_mix(&tx_nco, &ih, &qh);
+  }
+  if(tx_tune_mute)        // pan tuned far from the Si5351, no TX until hmi.c moves it
+  {
+    ih = 0;
+    qh = 0;
+  }
 
 
   if(aud_samples_state == AUD_STATE_SAMP_IN)    //store variables for scope graphic
     {
       aud_samp[AUD_SAMP_I][aud_samp_block_pos] = qh>>2;
-      aud_samp[AUD_SAMP_Q][aud_samp_block_pos] = a_s[7]>>2;
+      aud_samp[AUD_SAMP_Q][aud_samp_block_pos] = ih>>2;
     }
   
 
@@ -2175,7 +3175,7 @@ bool tx(void)
 	else
 		q_dac = a_accu;
 	
-	a_accu = DAC_BIAS + (a_s[7]>>5);  //>>4 to change from ADC 4096 range to 256 PWM range  (>>4 seems saturate)
+	a_accu = DAC_BIAS + (ih>>5);  //>>4 to change from ADC 4096 range to 256 PWM range  (>>4 seems saturate)
 	if (a_accu<0)
 		i_dac = 0;
 	else if (a_accu>(int16_t)(DAC_RANGE))
@@ -2186,8 +3186,10 @@ bool tx(void)
 	// pwm_set_both_levels(dac_iq, q_dac, i_dac);		// Set both channels of the IQ slice simultaneously
 	// pwm_set_chan_level(dac_iq, PWM_CHAN_A, q_dac);
 	// pwm_set_chan_level(dac_iq, PWM_CHAN_B, i_dac);
-	pwm_set_gpio_level(21, i_dac);
-	pwm_set_gpio_level(20, q_dac);
+	// pwm_set_gpio_level(21, i_dac);
+	// pwm_set_gpio_level(20, q_dac);
+	dac_i_level = i_dac;     // played by core1 one block later
+	dac_q_level = q_dac;
 	
 
   //store variables for scope graphic
@@ -2217,13 +3219,383 @@ bool tx(void)
 
 
 
+#define FFT_NUM_SIZE   3u    // 256 512 1024
+#if FFT_METHOD == FFT_REAL_HILBERT
 int16_t fft_i_s[HILBERT_TAP_NUM], fft_q_s[HILBERT_TAP_NUM];          // Filtered I/Q samples
-kiss_fft_scalar fft_in_minus[FFT_NSAMP]; // kiss_fft_scalar is a float
-kiss_fft_scalar fft_in_plus[FFT_NSAMP]; // kiss_fft_scalar is a float
-kiss_fft_cpx fft_out[FFT_NSAMP];
-kiss_fftr_cfg fft_cfg; // = kiss_fftr_alloc(FFT_NSAMP,false,0,0);
-int16_t qh;  
-uint16_t block_num;
+kiss_fft_scalar fft_in_minus[FFT_NSAMP_MAX]; // kiss_fft_scalar is a float
+kiss_fft_scalar fft_in_plus[FFT_NSAMP_MAX]; // kiss_fft_scalar is a float
+kiss_fftr_cfg fft_cfg_size[FFT_NUM_SIZE];   // one config (twiddles) for each size, allocated on setup
+kiss_fftr_cfg fft_cfg;                      // config of the size in use
+int16_t qh;
+#else
+kiss_fft_cpx fft_in[FFT_NSAMP_MAX];   // I + jQ samples
+kiss_fft_cfg fft_cfg_size[FFT_NUM_SIZE];    // one config (twiddles) for each size, allocated on setup
+kiss_fft_cfg fft_cfg;                       // config of the size in use
+#endif
+kiss_fft_cpx fft_out[FFT_NSAMP_MAX];
+uint32_t fft_pow[FFT_NSAMP_MAX];      // power of all bins of the last FFT, -band to +band
+uint8_t fft_line[FFT_NSAMP_MAX];      // waterfall levels of all bins, -band to +band, before the resample to the display columns
+uint8_t fft_row[GRAPH_NUM_COLS];      // last FFT resampled to the display columns
+
+// spectrum averaging and peak hold, per bin power in Q-3 (as fft_pow[])
+uint32_t spec_avg[FFT_NSAMP_MAX];     // exponential average, or sum of the FFTs for the linear average
+uint32_t spec_peak[FFT_NSAMP_MAX];    // decaying peak hold
+uint8_t spec_peak_line[FFT_NSAMP_MAX];   // peak levels of all bins
+volatile uint16_t spec_avg_mode = SPEC_AVG_DEFAULT;
+volatile uint16_t spec_avg_k = SPEC_AVG_K_DEFAULT;
+volatile uint16_t spec_peak_decay = SPEC_PEAK_DECAY_DEFAULT;
+volatile bool spec_restart = true;    // clear the averages (new mode, FFT size, rate or zoom)
+uint16_t spec_nfft = 0;               // FFTs on the average since the restart
+uint32_t spec_samp_start = 0;         // fft_samp_start of the FFTs on the average
+
+
+
+/**************************************************************************************
+ * FFT size: 256, 512 or 1024 points, only asked here (any core)
+ * core1 changes it between two FFTs with fft_size_apply()
+ **************************************************************************************/
+void dsp_set_fft_size(uint16_t n)
+{
+  if((n == FFT_SIZE_256) || (n == FFT_SIZE_512) || (n == FFT_SIZE_1024))
+  {
+    fft_nsamp_req = n;
+  }
+}
+
+/**************************************************************************************
+ * spectrum averaging:  SPEC_AVG_OFF = each FFT as it is
+ *   SPEC_AVG_EXP = exponential average, avg += (pow - avg) / 2^k
+ *   SPEC_AVG_LIN = mean of 2^k FFTs, one result each 2^k FFTs
+ * peak_decay = peak hold falls 1/2^peak_decay each FFT  (0 = no peak hold)
+ * only asked here (any core), core1 clears the averages on the next FFT
+ **************************************************************************************/
+void dsp_set_spec_avg(uint16_t mode, uint16_t k, uint16_t peak_decay)
+{
+  if((mode < SPEC_AVG_NUM) && (k >= 1) && (k <= SPEC_AVG_K_MAX) && (peak_decay <= SPEC_PEAK_DECAY_MAX))
+  {
+    spec_avg_mode = mode;
+    spec_avg_k = k;
+    spec_peak_decay = peak_decay;
+    spec_restart = true;
+  }
+}
+
+/* waterfall level of one averaged bin, the bin goes to the auto range histogram */
+static inline uint8_t spec_level(uint32_t p)
+{
+  uint16_t l = pow_log2_q4(p);
+
+  wf_hist_add(l);
+  return wf_level_log2(l);
+}
+
+/**************************************************************************************
+ * CORE1: average and peak hold of the bin power fft_pow[] (n bins, -band to +band)
+ * levels on fft_line[] and spec_peak_line[]
+ * returns false when there is no new result  (linear average not complete)
+ **************************************************************************************/
+static bool spec_update(uint16_t n)
+{
+  uint16_t b;
+  uint16_t k = spec_avg_k;
+  uint16_t decay = spec_peak_decay;
+  uint32_t p;
+
+  if(spec_restart)
+  {
+    spec_restart = false;
+    spec_nfft = 0;
+    memset(spec_peak, 0, sizeof(spec_peak));
+    memset(spec_peak_line, 0, sizeof(spec_peak_line));
+  }
+  spec_nfft++;
+
+  switch(spec_avg_mode)
+  {
+    case SPEC_AVG_EXP:
+      for(b=0; b<n; b++)
+      {
+        if(spec_nfft == 1)
+        {
+          spec_avg[b] = fft_pow[b];   // start from the first FFT, not from 0
+        }
+        else
+        {
+          spec_avg[b] += (int32_t)(fft_pow[b] - spec_avg[b]) >> k;
+        }
+        fft_line[b] = spec_level(spec_avg[b]);
+      }
+      break;
+
+    case SPEC_AVG_LIN:
+      for(b=0; b<n; b++)
+      {
+        spec_avg[b] = (spec_nfft == 1) ? fft_pow[b] : (spec_avg[b] + fft_pow[b]);
+      }
+      if(spec_nfft < (1u << k))
+      {
+        return false;
+      }
+      spec_nfft = 0;
+      for(b=0; b<n; b++)
+      {
+        fft_line[b] = spec_level(spec_avg[b] >> k);
+      }
+      break;
+
+    default:  //SPEC_AVG_OFF
+      for(b=0; b<n; b++)
+      {
+        fft_line[b] = spec_level(fft_pow[b]);
+      }
+      break;
+  }
+  wf_auto_range(n);
+
+  if(decay > 0)
+  {
+    for(b=0; b<n; b++)
+    {
+      p = spec_peak[b] - (spec_peak[b] >> decay);
+      spec_peak[b] = (fft_pow[b] > p) ? fft_pow[b] : p;
+      spec_peak_line[b] = wf_level_pow(spec_peak[b]);
+    }
+  }
+
+  return true;
+}
+
+/**************************************************************************************
+ * CORE1: block floating point for the FFT input
+ * biggest left shift of the n samples (both channels) that keeps them under FFT_BFP_MAX:
+ * weak signals use the whole int16 range of the fixed point FFT, strong ones do not overflow
+ * a new shift scales the averages (power = 4^shift) so they go on with the new FFTs
+ **************************************************************************************/
+#if FFT_METHOD == FFT_REAL_HILBERT
+#define FFT_BFP_MAX   (1 << 13)    // I +- H(Q) can be 2x the input
+#else
+#define FFT_BFP_MAX   (1 << 14)
+#endif
+#define FFT_BFP_SHIFT_MAX   10
+#define SPEC_POW_SAT        0x7fffffffUL
+
+static void fft_bfp_set(uint16_t n)
+{
+  uint16_t j, b;
+  int32_t m = 1, a;
+  int16_t sh, d;
+
+  for(j=0; j<n; j++)
+  {
+    a = ABS(FFT_SAMP(0, j));
+    m = (a > m) ? a : m;
+    a = ABS(FFT_SAMP(1, j));
+    m = (a > m) ? a : m;
+  }
+  for(sh=0; (sh < FFT_BFP_SHIFT_MAX) && ((m << (sh+1)) <= FFT_BFP_MAX); sh++) { }
+
+  d = sh - fft_bfp_shift;
+  if(d == 0)
+  {
+    return;
+  }
+  for(b=0; b<FFT_NSAMP_MAX; b++)
+  {
+    if(d < 0)
+    {
+      spec_avg[b] >>= (-2*d);
+      spec_peak[b] >>= (-2*d);
+    }
+    else
+    {
+      spec_avg[b] = (spec_avg[b] > (SPEC_POW_SAT >> (2*d))) ? SPEC_POW_SAT : (spec_avg[b] << (2*d));
+      spec_peak[b] = (spec_peak[b] > (SPEC_POW_SAT >> (2*d))) ? SPEC_POW_SAT : (spec_peak[b] << (2*d));
+    }
+  }
+  fft_bfp_shift = sh;
+}
+
+/**************************************************************************************
+ * FFT overlap 0 50 75%:  new FFT each fft_nsamp, fft_nsamp/2 or fft_nsamp/4 samples
+ **************************************************************************************/
+void dsp_set_fft_overlap(uint16_t ovl)
+{
+  if((ovl == FFT_OVERLAP_0) || (ovl == FFT_OVERLAP_50) || (ovl == FFT_OVERLAP_75))
+  {
+    fft_overlap = ovl;
+  }
+}
+
+/**************************************************************************************
+ * zoom FFT: 1 = off,  2 4 8 16 = span fsamp_ch / zoom centered on the tuned freq + offset_hz
+ * only asked here (any core), dma_handler() applies it between blocks
+ **************************************************************************************/
+void dsp_set_fft_zoom(uint16_t zoom, int32_t offset_hz)
+{
+  if((zoom == 1) || (zoom == 2) || (zoom == 4) || (zoom == 8) || (zoom == 16))
+  {
+    fft_zoom_offset_req = offset_hz;
+    fft_zoom_req = zoom;
+    fft_zoom_new = 1;
+  }
+}
+
+/**************************************************************************************
+ * fine tuning (hmi.c), RIT, XIT and IF shift in Hz, new NCO steps for rx() and tx()
+ **************************************************************************************/
+void dsp_set_tune(int32_t hz)
+{
+  hz = dsp_shift_limit(hz, DSP_PAN_MAX_HZ);
+  if(hz != dsp_tune_hz)
+  {
+    dsp_tune_hz = hz;
+    dsp_shift_update();
+    if(fft_zoom_req > 1)
+    {
+      fft_zoom_new = 1;      // zoom NCO follows the tuned freq
+    }
+  }
+}
+
+void dsp_set_rit(int32_t hz)
+{
+  rit_hz = dsp_shift_limit(hz, DSP_SHIFT_MAX_HZ);
+  dsp_shift_update();
+}
+
+void dsp_set_xit(int32_t hz)
+{
+  xit_hz = dsp_shift_limit(hz, DSP_SHIFT_MAX_HZ);
+  dsp_shift_update();
+}
+
+void dsp_set_if_shift(int32_t hz)
+{
+  if_shift_hz = dsp_shift_limit(hz, DSP_SHIFT_MAX_HZ);
+  dsp_shift_update();
+}
+
+/**************************************************************************************
+ * FM: squelch 0 = open, 1 - 9 = closes with less noise,  TX max deviation in Hz
+ **************************************************************************************/
+void dsp_set_fm(uint16_t squelch, uint16_t dev_hz)
+{
+  if(squelch <= FM_SQL_MAX)
+  {
+    fm_squelch = squelch;
+  }
+  if((dev_hz >= FM_DEV_MIN_HZ) && (dev_hz <= FM_DEV_MAX_HZ))
+  {
+    fm_dev_hz = dev_hz;
+    fm_dev_k = (uint32_t)(((uint64_t)dev_hz << (32 - FM_MIC_SHIFT)) / FSAMP_AUDIO);
+  }
+}
+
+/**************************************************************************************
+ * bins -band .. +band resampled to the waterfall columns
+ * more bins than columns: max of the bins of each column (a narrow signal is not lost)
+ * less bins than columns: each bin repeated
+ **************************************************************************************/
+static void fft_line_to_cols(const uint8_t *lvl, uint16_t n, uint8_t *row)
+{
+  uint16_t c, b, b1;
+  uint8_t m;
+
+  for(c=0; c<GRAPH_NUM_COLS; c++)
+  {
+    b = (uint16_t)(((uint32_t)c * n) / GRAPH_NUM_COLS);
+    b1 = (uint16_t)(((uint32_t)(c+1) * n) / GRAPH_NUM_COLS);
+    m = lvl[b];
+    for(b++; b<b1; b++)
+    {
+      if(lvl[b] > m)
+      {
+        m = lvl[b];
+      }
+    }
+    row[c] = m;
+  }
+}
+
+
+
+/**************************************************************************************
+ * FFT window, Q15 coefficients applied while the samples are copied to the FFT input
+ * only asked by dsp_set_fft_window() (any core), core1 calculates the table with fft_window_apply()
+ * between two FFTs (as the FFT size), never while the samples are copied
+ **************************************************************************************/
+int16_t fft_window[FFT_NSAMP_MAX];
+volatile uint16_t fft_window_type = FFT_WINDOW_HANN;  //window of the table in use
+volatile uint16_t fft_window_req = FFT_WINDOW_HANN;   //new window asked by dsp_set_fft_window(), changed by core1 between two FFTs
+#define FFT_WINDOW(x, n)   ((int16_t)(((int32_t)(x) * fft_window[n]) >> 15))
+
+void dsp_set_fft_window(uint16_t win)
+{
+  if(win < FFT_WINDOW_NUM)
+  {
+    fft_window_req = win;
+  }
+}
+
+/* CORE1: window table for the FFT size in use */
+static void fft_window_apply(uint16_t win)
+{
+  uint16_t n, nsamp = fft_nsamp;
+  float c1, c2, c3, c4, w;
+
+  for(n=0; n<nsamp; n++)
+  {
+    c1 = cosf((2.0f * (float)PI * n) / nsamp);
+    c2 = cosf((4.0f * (float)PI * n) / nsamp);
+    c3 = cosf((6.0f * (float)PI * n) / nsamp);
+    c4 = cosf((8.0f * (float)PI * n) / nsamp);
+    switch(win)
+    {
+      case FFT_WINDOW_HANN:
+        w = 0.5f - 0.5f*c1;
+        break;
+      case FFT_WINDOW_BLACKMAN_HARRIS:
+        w = 0.35875f - 0.48829f*c1 + 0.14128f*c2 - 0.01168f*c3;
+        break;
+      case FFT_WINDOW_FLAT_TOP:
+        w = 0.21557895f - 0.41663158f*c1 + 0.277263158f*c2 - 0.083578947f*c3 + 0.006947368f*c4;
+        break;
+      default:  //FFT_WINDOW_RECT
+        w = 1.0f;
+        break;
+    }
+    w = w * 32768.0f;
+    fft_window[n] = (w > 32767.0f) ? 32767 : (int16_t)w;
+  }
+  fft_window_type = win;
+}
+
+
+
+/**************************************************************************************
+ * CORE1: change the FFT size asked by dsp_set_fft_size()
+ * the ring keeps the samples, the next FFT uses the new size
+ **************************************************************************************/
+static void fft_size_apply(uint16_t n)
+{
+  uint16_t i;
+
+  for(i=0; i<FFT_NUM_SIZE; i++)
+  {
+    if(n == (FFT_SIZE_256 << i))
+    {
+      fft_cfg = fft_cfg_size[i];
+    }
+  }
+  fft_nsamp = n;
+  fft_samp_need = n + FFT_SAMP_EXTRA;
+  fft_fres = (uint16_t)(fsamp_ch / ((uint32_t)n * fft_zoom));
+  fft_window_apply(fft_window_req);
+  spec_restart = true;    // bins changed
+}
+
+
+
 uint16_t block_pos;
 uint16_t aux_c1 = 0;
 uint16_t i_c1, j_c1;
@@ -2254,7 +3626,15 @@ void dsp_core1_setup_and_loop()
   
   
   //fft setup
-  fft_cfg = kiss_fftr_alloc(FFT_NSAMP,false,0,0);
+  for(i_c1=0; i_c1<FFT_NUM_SIZE; i_c1++)
+  {
+#if FFT_METHOD == FFT_REAL_HILBERT
+    fft_cfg_size[i_c1] = kiss_fftr_alloc((FFT_SIZE_256 << i_c1),false,0,0);
+#else
+    fft_cfg_size[i_c1] = kiss_fft_alloc((FFT_SIZE_256 << i_c1),false,0,0);
+#endif
+  }
+  fft_size_apply(fft_nsamp_req);
 
 
 
@@ -2287,33 +3667,44 @@ void dsp_core1_setup_and_loop()
 
 
 
-  // Configure a channel to write the same word (32 bits) repeatedly to PIO0
-  // SM0's TX FIFO, paced by the data request signal from that peripheral.
-  dma_chan = dma_claim_unused_channel(true);
-  dma_channel_config cfg = dma_channel_get_default_config(dma_chan);
-  channel_config_set_transfer_data_size(&cfg, DMA_SIZE_16);
-  channel_config_set_read_increment(&cfg, false);
-  channel_config_set_write_increment(&cfg, true);
-  channel_config_set_dreq(&cfg, DREQ_ADC);
-
-  dma_channel_configure(
-      dma_chan,
-      &cfg,
-      &adc_samp[adc_samp_block_pos][0],   //dst
-      &adc_hw->fifo,    // src
-      BLOCK_NSAMP,        // Write the same value many times, then halt and interrupt
-      true              // start immediately
-  );
+  // Configure two channels to read the ADC FIFO into adc_samp[] blocks, paced by the ADC DREQ
+  // each channel chains to the other at the end of its block: the capture never stops
+  // dma_handler() only prepares the write address of the finished channel for its next block
+  // the writes wrap inside adc_samp[] (write ring): never out of the array, even when dma_handler() does not run
+  dma_chan[0] = dma_claim_unused_channel(true);
+  dma_chan[1] = dma_claim_unused_channel(true);
+  for(i_c1=0; i_c1<2; i_c1++)
+  {
+    dma_channel_config cfg = dma_channel_get_default_config(dma_chan[i_c1]);
+    channel_config_set_transfer_data_size(&cfg, DMA_SIZE_16);
+    channel_config_set_read_increment(&cfg, false);
+    channel_config_set_write_increment(&cfg, true);
+    channel_config_set_dreq(&cfg, DREQ_ADC);
+    channel_config_set_chain_to(&cfg, dma_chan[i_c1 ^ 1u]);
+    channel_config_set_ring(&cfg, true, ADC_SAMP_RING_BITS);
+
+    dma_channel_configure(
+        dma_chan[i_c1],
+        &cfg,
+        &adc_samp[i_c1][0],   //dst   block 0 and block 1
+        &adc_hw->fifo,    // src
+        BLOCK_NSAMP,        // one block, then chain to the other channel and interrupt
+        (i_c1 == 0)       // start only the first one
+    );
 
-  // Tell the DMA to raise IRQ line 0 when the channel finishes a block
-  dma_channel_set_irq0_enabled(dma_chan, true);
+    // Tell the DMA to raise IRQ line 0 when the channel finishes a block
+    dma_channel_set_irq0_enabled(dma_chan[i_c1], true);
+  }
+  dma_chan_irq = 0;
+  adc_samp_last_block_pos = 0;
+  adc_samp_block_pos = 1;
 
   // Configure the processor to run dma_handler() when DMA IRQ 0 is asserted
   irq_set_exclusive_handler(DMA_IRQ_0, dma_handler);
 
 
   // Clear the interrupt request.
-  dma_hw->ints0 = 1u << dma_chan;
+  dma_hw->ints0 = (1u << dma_chan[0]) | (1u << dma_chan[1]);
   
   irq_set_enabled(DMA_IRQ_0, true);
 
@@ -2344,20 +3735,39 @@ void dsp_core1_setup_and_loop()
     {
       uint32_t interrupts_Core1 = save_and_disable_interrupts();
 
-      //adc_run(false);
+      adc_dma_stop();      // no capture while dma_handler() can not run (flash erase/program)
       DFLASH_in_use = 2;
       while(DFLASH_in_use == 2);
-      //adc_run(true);
+      adc_dma_start();
+      fft_samp_start = fft_samp_pos;     // gap in the FFT samples
 
       restore_interrupts(interrupts_Core1);      
     }    
 
 
 
-    //wait for FFT input data to be processed
-    if((fft_samples_ready == 1) && //ready to start FFT with last samples
-       (fft_display_graf_new == 0))
+    //new FFT size: the ring has the samples, next FFT with the new size
+    if(fft_nsamp_req != fft_nsamp)
+    {
+      fft_size_apply(fft_nsamp_req);
+    }
+
+    //new FFT window: the table is only read while the samples are copied, below
+    if(fft_window_req != fft_window_type)
+    {
+      fft_window_apply(fft_window_req);
+    }
+
+    //FFT of the latest samples each hop = fft_nsamp x (100 - overlap)%  (or as fast as core1 can if it takes longer)
+    uint32_t pos = fft_samp_pos;
+    if(((pos - fft_samp_start) >= fft_samp_need) &&   //enough samples with the same rate and zoom
+       ((int32_t)(pos - fft_samp_next) >= 0))
     {
+      fft_samp_rd = pos - fft_samp_need;
+      fft_samp_next = pos + (((uint32_t)fft_nsamp * (100u - fft_overlap)) / 100u);
+
+      //input shift for the samples of this FFT
+      fft_bfp_set(fft_samp_need);
 
 #if 0  //send FFT samples to serial   it needs to use with extra serial on pins GP0 GP1
 
@@ -2369,36 +3779,28 @@ void dsp_core1_setup_and_loop()
             
             Serialx.print("\n====== FFT =======\n");
           
-            //fft_samp[NBLOCK_TOT][BLOCK_NSAMP]
-            Serialx.print("FFT_NUM_BLOCK=");
-            Serialx.print(FFT_NUM_BLOCK, DEC);
+            //fft_samp[2][FFT_SAMP_NSAMP]
+            Serialx.print("FFT_SAMP_NSAMP=");
+            Serialx.print(FFT_SAMP_NSAMP, DEC);
             Serialx.print(" BLOCK_NSAMP=");
             Serialx.print(BLOCK_NSAMP, DEC); 
             Serialx.print("\n");
               
-            for(j_c1=0; j_c1<FFT_NUM_BLOCK; j_c1++)
+            for(i_c1=0; i_c1<FFT_SAMP_NSAMP; i_c1++)
             {
-              for (i_c1=0; i_c1<BLOCK_NSAMP; i_c1+=3) 
-                  {
-                  Serialx.print((int)j_c1, DEC);
-                  Serialx.print(",");
                   Serialx.print((int)i_c1, DEC);
                   Serialx.print(",");
-                  Serialx.print((int)(fft_samp[j_c1][i_c1]), DEC);
+                  Serialx.print((int)(fft_samp[0][i_c1]), DEC);
                   Serialx.print(",");
-                  Serialx.print((int)(fft_samp[j_c1][i_c1+1]), DEC);
-                  Serialx.print(",");
-                  Serialx.print((int)(fft_samp[j_c1][i_c1+2]), DEC);
-                  Serialx.print(" ");
+                  Serialx.print((int)(fft_samp[1][i_c1]), DEC);
                   Serialx.print("\n");    
-                  }
             }
             
             Serialx.print("====== fim =======\n");
           
           /* 
             
-            for(j_c1=0; j_c1<FFT_NUM_BLOCK; j_c1++)
+            for(j_c1=0; j_c1<FFT_SAMP_NSAMP; j_c1++)
             {
               for (i_c1=0; i_c1<BLOCK_NSAMP; i_c1+=3) 
                   {
@@ -2439,29 +3841,24 @@ void dsp_core1_setup_and_loop()
 //#if 0
 
 
-//#if 0
-      block_num = 0;   
+#if FFT_METHOD == FFT_REAL_HILBERT
       block_pos = 0;
 
       // Hilbert H(Q)
       // fill first samples to calculate the first Hilbert value
-      for(j_c1=0; j_c1<HILBERT_TAP_NUM; j_c1++)
+      // [0] is shifted out before the first value: HILBERT_TAP_NUM-1 = FFT_SAMP_EXTRA samples, the last read is fft_samp_need-1
+      for(j_c1=1; j_c1<HILBERT_TAP_NUM; j_c1++)
       {
 #ifdef EXCHANGE_I_Q
-        fft_i_s[j_c1] = (fft_gain * fft_samp[block_num][block_pos]) >> FFT_GAIN_SHIFT;   
-        fft_q_s[j_c1] = (fft_gain * fft_samp[block_num][block_pos+1]) >> FFT_GAIN_SHIFT;;
+        fft_i_s[j_c1] = (FFT_SAMP(0, block_pos) << fft_bfp_shift);   
+        fft_q_s[j_c1] = (FFT_SAMP(1, block_pos) << fft_bfp_shift);
 #else
-        fft_q_s[j_c1] = (fft_gain * fft_samp[block_num][block_pos]) >> FFT_GAIN_SHIFT;;   
-        fft_i_s[j_c1] = (fft_gain * fft_samp[block_num][block_pos+1]) >> FFT_GAIN_SHIFT;;
+        fft_q_s[j_c1] = (FFT_SAMP(0, block_pos) << fft_bfp_shift);   
+        fft_i_s[j_c1] = (FFT_SAMP(1, block_pos) << fft_bfp_shift);
 #endif
-        block_pos+=3;
-        if(block_pos >= BLOCK_NSAMP)
-        {
-          block_num++;
-          block_pos = 0; 
-        }
+        block_pos++;
       }
-      for(j_c1=0; j_c1<FFT_NSAMP; j_c1++)
+      for(j_c1=0; j_c1<fft_nsamp; j_c1++)
       {
         for (i_c1=0; i_c1<(HILBERT_TAP_NUM-1); i_c1++)   // Shift decimated samples
         {
@@ -2469,49 +3866,35 @@ void dsp_core1_setup_and_loop()
           fft_i_s[i_c1] = fft_i_s[i_c1+1];
         }
 #ifdef EXCHANGE_I_Q
-        fft_i_s[(HILBERT_TAP_NUM-1)] = (fft_gain * fft_samp[block_num][block_pos]) >> FFT_GAIN_SHIFT;
-        fft_q_s[(HILBERT_TAP_NUM-1)] = (fft_gain * fft_samp[block_num][block_pos+1]) >> FFT_GAIN_SHIFT;
+        fft_i_s[(HILBERT_TAP_NUM-1)] = (FFT_SAMP(0, block_pos) << fft_bfp_shift);
+        fft_q_s[(HILBERT_TAP_NUM-1)] = (FFT_SAMP(1, block_pos) << fft_bfp_shift);
 #else
-        fft_q_s[(HILBERT_TAP_NUM-1)] = (fft_gain * fft_samp[block_num][block_pos]) >> FFT_GAIN_SHIFT;
-        fft_i_s[(HILBERT_TAP_NUM-1)] = (fft_gain * fft_samp[block_num][block_pos+1]) >> FFT_GAIN_SHIFT;
+        fft_q_s[(HILBERT_TAP_NUM-1)] = (FFT_SAMP(0, block_pos) << fft_bfp_shift);
+        fft_i_s[(HILBERT_TAP_NUM-1)] = (FFT_SAMP(1, block_pos) << fft_bfp_shift);
 #endif
      
         qh = ((int32_t)(fft_q_s[0]-fft_q_s[14])*315L + (int32_t)(fft_q_s[2]-fft_q_s[12])*440L + 
               (int32_t)(fft_q_s[4]-fft_q_s[10])*734L + (int32_t)(fft_q_s[6]-fft_q_s[ 8])*2202L) >> 12;  // / 4096L
         //qh = ((int32_t)(fft_q_s[0]-fft_q_s[14])*315 + (int32_t)(fft_q_s[2]-fft_q_s[12])*440 + 
         //      (int32_t)(fft_q_s[4]-fft_q_s[10])*734 + (int32_t)(fft_q_s[6]-fft_q_s[ 8])*2202) >> 12;  // / 4096L
-        fft_in_minus[j_c1] = fft_i_s[7] - qh;  //USB
-        fft_in_plus[j_c1] = fft_i_s[7] + qh;   //LSB
+        fft_in_minus[j_c1] = FFT_WINDOW(fft_i_s[7] - qh, j_c1);  //USB
+        fft_in_plus[j_c1] = FFT_WINDOW(fft_i_s[7] + qh, j_c1);   //LSB
 
 
-        block_pos+=3;
-        if(block_pos >= BLOCK_NSAMP)
-        {
-          block_num++;
-          block_pos = 0; 
-        }          
+        block_pos++;
       }
 //#endif
 
 #if 0
-      block_num = 0;   
-      block_pos = 0;
-      
-      for(j_c1=0; j_c1<FFT_NSAMP; j_c1++)  //320
+      for(j_c1=0; j_c1<fft_nsamp; j_c1++)
       {
 #ifdef EXCHANGE_I_Q
-        fft_in_plus[j_c1] = fft_samp[block_num][block_pos];
-        fft_in_minus[j_c1] = fft_samp[block_num][block_pos+1]; 
+        fft_in_plus[j_c1] = fft_samp[0][j_c1];
+        fft_in_minus[j_c1] = fft_samp[1][j_c1]; 
 #else
-        fft_in_minus[j_c1] = fft_samp[block_num][block_pos];
-        fft_in_plus[j_c1] = fft_samp[block_num][block_pos+1]; 
+        fft_in_minus[j_c1] = fft_samp[0][j_c1];
+        fft_in_plus[j_c1] = fft_samp[1][j_c1]; 
 #endif
-        block_pos+=3;
-        if(block_pos >= BLOCK_NSAMP)
-        {
-          block_num++;
-          block_pos = 0; 
-        }
       }
 #endif
 
@@ -2523,17 +3906,11 @@ void dsp_core1_setup_and_loop()
 
 
       // fill line for graphic  -band to 0
-      for(i_c1=0; i_c1<FFT_NUMFREQ; i_c1++)
+      for(i_c1=0; i_c1<(fft_nsamp/2); i_c1++)
       {
-        if(MAG(fft_out[i_c1].r, fft_out[i_c1].i) > 1)
-        {
-          vet_graf_fft[(GRAPH_NUM_LINES-1)][(FFT_NUMFREQ-1)+i_c1] = 1;
-        }
-        else
-        {
-          vet_graf_fft[(GRAPH_NUM_LINES-1)][(FFT_NUMFREQ-1)+i_c1] = 0;
-        }
+        fft_pow[((fft_nsamp/2)-1)+i_c1] = POW(fft_out[i_c1].r, fft_out[i_c1].i);
       }
+      fft_pow[fft_nsamp-1] = 0;
 
       
       // FFT  I - H(Q)
@@ -2541,20 +3918,44 @@ void dsp_core1_setup_and_loop()
 
 
       // fill line for graphic  0 to +band
-      for(i_c1=0; i_c1<FFT_NUMFREQ; i_c1++)
+      for(i_c1=0; i_c1<(fft_nsamp/2); i_c1++)
       {
-        if(MAG(fft_out[i_c1].r, fft_out[i_c1].i) > 1)
-        {
-          vet_graf_fft[(GRAPH_NUM_LINES-1)][FFT_NUMFREQ-i_c1] = 1;
-        }
-        else
-        {
-          vet_graf_fft[(GRAPH_NUM_LINES-1)][FFT_NUMFREQ-i_c1] = 0;
-        }
+        fft_pow[(fft_nsamp/2)-i_c1] = POW(fft_out[i_c1].r, fft_out[i_c1].i);
+
+      }
+
+#else  //FFT_METHOD == FFT_COMPLEX_IQ
+
+      // I + jQ  straight from the I and Q sample arrays, no Hilbert (no filter edge effects), window applied in the same pass
+      for(j_c1=0; j_c1<fft_nsamp; j_c1++)
+      {
+#ifdef EXCHANGE_I_Q
+        fft_in[j_c1].r = FFT_WINDOW((FFT_SAMP(0, j_c1) << fft_bfp_shift), j_c1);
+        fft_in[j_c1].i = FFT_WINDOW((FFT_SAMP(1, j_c1) << fft_bfp_shift), j_c1);
+#else
+        fft_in[j_c1].i = FFT_WINDOW((FFT_SAMP(0, j_c1) << fft_bfp_shift), j_c1);
+        fft_in[j_c1].r = FFT_WINDOW((FFT_SAMP(1, j_c1) << fft_bfp_shift), j_c1);
+#endif
+      }
 
+
+      // FFT  I + jQ   (one complex FFT instead of the two real FFTs of about 30ms each)
+      kiss_fft(fft_cfg, fft_in, fft_out);
+
+
+      // fill line for graphic  0 to +band  = positive bins 0 .. N/2-1
+      for(i_c1=0; i_c1<(fft_nsamp/2); i_c1++)
+      {
+        fft_pow[(fft_nsamp/2)+i_c1] = POW(fft_out[i_c1].r, fft_out[i_c1].i);
       }
 
+      // fill line for graphic  -band to 0  = negative bins N/2 .. N-1
+      for(i_c1=(fft_nsamp/2); i_c1<fft_nsamp; i_c1++)
+      {
+        fft_pow[i_c1-(fft_nsamp/2)] = POW(fft_out[i_c1].r, fft_out[i_c1].i);
+      }
 
+#endif  //FFT_METHOD
 
 #if 0
 
@@ -2562,22 +3963,22 @@ void dsp_core1_setup_and_loop()
           {
                   Serialx.print("\n FFT \n");  
 
-  
-                  //fft_samp[FFT_NUM_BLOCK][BLOCK_NSAMP]
-                  Serialx.print("fft_samp[FFT_NUM_BLOCK][BLOCK_NSAMP]    FFT_NUM_BLOCK=");
-                  Serialx.print(FFT_NUM_BLOCK, DEC);  //13
+
+                  //fft_samp[2][FFT_SAMP_NSAMP]
+                  Serialx.print("fft_samp[2][FFT_SAMP_NSAMP]    FFT_SAMP_NSAMP=");
+                  Serialx.print(FFT_SAMP_NSAMP, DEC);
                   Serialx.print("   BLOCK_NSAMP=");
                   Serialx.print(BLOCK_NSAMP, DEC);   //30
                   Serialx.print("\n");
-                  Serialx.print("fft_in_minus[FFT_NSAMP]    FFT_NSAMP=");
-                  Serialx.print(FFT_NSAMP, DEC);   //320
-                  Serialx.print("    fft_out[FFT_NSAMP]     FFT_NSAMP=");
-                  Serialx.print(FFT_NSAMP, DEC);   //320
-                  Serialx.print("    FFT_NUMFREQ=");
-                  Serialx.print(FFT_NUMFREQ, DEC);   //160
+                  Serialx.print("fft_in_minus[fft_nsamp]    fft_nsamp=");
+                  Serialx.print(fft_nsamp, DEC);
+                  Serialx.print("    fft_out[fft_nsamp]     fft_nsamp=");
+                  Serialx.print(fft_nsamp, DEC);
+                  Serialx.print("    fft_nsamp/2=");
+                  Serialx.print(fft_nsamp/2, DEC);
                   Serialx.print("\n");                  
 
-                  for(i_c1=0; i_c1<FFT_NUMFREQ; i_c1++)
+                  for(i_c1=0; i_c1<(fft_nsamp/2); i_c1++)
                   {
                   Serialx.print((int)i_c1, DEC);
                   Serialx.print(",");
@@ -2588,7 +3989,7 @@ void dsp_core1_setup_and_loop()
                   Serialx.print((int)fft_out[i_c1].i, DEC);
                   Serialx.print(",");                    
                   Serialx.print((int)MAG(fft_out[i_c1].r, fft_out[i_c1].i), DEC);
-                  
+                
                   Serialx.print("\n");  
                   }   
           }
@@ -2597,9 +3998,52 @@ void dsp_core1_setup_and_loop()
 #endif
 
 
- 
-      //graphic data is ready for graphic plotting  
-      fft_display_graf_new = 1;
+      // new rate or zoom on the samples: the average starts again
+      if(fft_samp_start != spec_samp_start)
+      {
+        spec_samp_start = fft_samp_start;
+        spec_restart = true;
+      }
+
+      // average and peak hold of the bins, then one waterfall line and one panadapter trace
+      if(spec_update(fft_nsamp))
+      {
+        // one waterfall line with the display width
+        fft_line_to_cols(fft_line, fft_nsamp, fft_row);
+        if(fft_display_graf_new == 0)
+        {
+          // last line taken by the display: new line on the ring (the display never draws the line after the head)
+          i_c1 = (vet_graf_fft_pos >= (GRAPH_RING_LINES-1)) ? 0 : (vet_graf_fft_pos+1);
+          memcpy(vet_graf_fft[i_c1], fft_row, GRAPH_NUM_COLS);
+          vet_graf_fft_pos = i_c1;
+        }
+        else
+        {
+          // display is late: max of the FFTs on the same line, a short signal is not lost
+          for(i_c1=0; i_c1<GRAPH_NUM_COLS; i_c1++)
+          {
+            if(fft_row[i_c1] > vet_graf_fft[vet_graf_fft_pos][i_c1])
+            {
+              vet_graf_fft[vet_graf_fft_pos][i_c1] = fft_row[i_c1];
+            }
+          }
+        }
+
+#if PAN_NUM_LINES > 0
+        // panadapter: always on the back buffer, swapped only when the display took the front one
+        i_c1 = pan_trace_front ^ 1u;
+        fft_line_to_cols(fft_line, fft_nsamp, pan_trace[i_c1][PAN_TRACE_AVG]);
+        fft_line_to_cols(spec_peak_line, fft_nsamp, pan_trace[i_c1][PAN_TRACE_PEAK]);
+        if(pan_trace_new == 0)
+        {
+          pan_trace_front = i_c1;
+          pan_trace_new = 1;
+        }
+#endif
+
+        //graphic data is ready for graphic plotting  
+        fft_display_graf_new = 1;
+      }
 
 //#endif
 
@@ -2649,6 +4093,15 @@ void dsp_init()
   
   tx_enabled = false;
 
+  dsp_set_wf_range(WF_FLOOR_DB, WF_SPAN_DB);   //waterfall intensity range
+
+  for(uint16_t pos=0; pos<AUDIO_OUT_PREFILL; pos++)   //audio output ring starts with some samples at DAC middle level
+  {
+    audio_out[pos][AUDIO_OUT_AUD] = DAC_BIAS;
+    audio_out[pos][AUDIO_OUT_I] = DAC_BIAS;
+    audio_out[pos][AUDIO_OUT_Q] = DAC_BIAS;
+  }
+
   //analogWriteResolution(12);
 
 
@@ -19,10 +19,44 @@ extern "C" {
 #define FSAMP 480000UL  // freq AD sample / 3 channels = 160kHz
 #define FSAMP_AUDIO 16000U  // audio freq sample   32kHz=critical time
 #define ADC_CLOCK_DIV ((uint16_t)(48000000UL/FSAMP))  //48Mhz / 480Khz = 100 
-#define FRES      500u    //Hz resolucao de frequencias desejado para cada bin
-#define FFT_NSAMP      ((((uint16_t)((FSAMP / 3u) / FRES))+1u) & (~(uint16_t)1u))  // must be even  160k / 500 = 320
-//FFT max freq = (FSAMP/3) / 2
-#define FFT_NUMFREQ    (FFT_NSAMP/2)
+//FFT size selected at run time, power of 2 = only radix 4 and radix 2 butterflies on kiss_fft (with the twiddles calculated on the alloc)
+//FFT resolution = (FSAMP/3) / fft_nsamp    160kHz / 256 = 625Hz    / 512 = 312Hz    / 1024 = 156Hz
+//FFT max freq = (FSAMP/3) / 2,  the waterfall shows the whole band for any size (bins resampled to the display columns)
+#define FFT_SIZE_256      256u
+#define FFT_SIZE_512      512u
+#define FFT_SIZE_1024     1024u
+#define FFT_NSAMP_MAX     FFT_SIZE_1024
+#define FFT_NSAMP_DEFAULT FFT_SIZE_256
+extern volatile uint16_t fft_nsamp;    // FFT points in use
+void dsp_set_fft_size(uint16_t n);
+//the I Q samples are saved all the time on a ring, core1 makes a new FFT of the latest samples each hop
+//overlap 50% = hop fft_nsamp/2,  75% = hop fft_nsamp/4  (waterfall lines limited by the core1 time, not by the display)
+#define FFT_OVERLAP_0        0u
+#define FFT_OVERLAP_50       50u
+#define FFT_OVERLAP_75       75u
+#define FFT_OVERLAP_DEFAULT  FFT_OVERLAP_50
+extern volatile uint16_t fft_overlap;  // % of samples shared by two FFTs
+void dsp_set_fft_overlap(uint16_t ovl);
+//zoom FFT: I Q mixed with a NCO and decimated by 2 4 8 16 before the FFT, the waterfall shows fsamp_ch/zoom around the tuned freq + offset
+//zoom 8 with 1024 points @240kHz = 30kHz span with 29Hz bins
+extern volatile uint16_t fft_zoom;          // 1 = no zoom
+extern volatile int32_t fft_zoom_offset;    // Hz, zoom center from the tuned freq
+void dsp_set_fft_zoom(uint16_t zoom, int32_t offset_hz);
+//tuning, RIT, XIT and IF shift with NCO mixers on the I Q (no Si5351 retune = no I2C, no click)
+//RX: I Q * e^-j(pan tune) @fsamp_ch -> decimator -> * e^-j(fine tune+rit+ifs) -> mode filter -> * e^+j(ifs) -> demod
+//TX: mod -> I Q shifted by tune+xit  (tune up to DSP_TUNE_MAX_HZ, farther = TX muted until the Si5351 moves)
+#define DSP_TUNE_MAX_HZ    1000   // the Si5351 moves only when the tuned freq is farther than this
+#define DSP_PAN_MAX_HZ    64000   // pan tuning (PAN SNAP cursor): RX tuned up to +-64kHz from the Si5351 (waterfall +-80kHz, the rest = margin for the RIT IF shift excess)
+#define DSP_SHIFT_MAX_HZ   3000   // RIT XIT IF shift limit  (audio I Q passband)
+extern volatile int32_t dsp_tune_hz;    // tuned freq - Si5351 freq
+extern volatile bool tx_tune_mute;      // tuned freq too far from the Si5351 for TX
+extern volatile int32_t rit_hz;
+extern volatile int32_t xit_hz;
+extern volatile int32_t if_shift_hz;
+void dsp_set_tune(int32_t hz);
+void dsp_set_rit(int32_t hz);
+void dsp_set_xit(int32_t hz);
+void dsp_set_if_shift(int32_t hz);
 
 
 
@@ -57,9 +91,34 @@ extern "C" {
 
 #define  LOW_PASS_16KHZ_AVERAGE_SUM   11
 #define  LOW_PASS_16KHZ_FIR  55
+#define  LOW_PASS_16KHZ_CIC  77
 // choose with type of filter used for I and Q after  160kHz sampling  to deliever to the 16kHz audio process
+// LOW_PASS_16KHZ_CIC = CIC decimator (only adds) + 7 taps compensation FIR @16kHz, better rejection of stations 16kHz away and less cycles than the FIR
 //#define LOW_PASS_16KHZ  LOW_PASS_16KHZ_AVERAGE_SUM
-#define LOW_PASS_16KHZ  LOW_PASS_16KHZ_FIR
+//#define LOW_PASS_16KHZ  LOW_PASS_16KHZ_FIR
+#define LOW_PASS_16KHZ  LOW_PASS_16KHZ_CIC
+#define CIC_ORDER   5    // CIC stages 4 or 5   (alias rejection @ 16kHz +-3kHz: 4 = -52dB, 5 = -65dB)
+
+
+
+// ADC channel plan: on RX (no PTT and VOX off) the MIC is removed from the ADC round robin
+// I and Q are sampled @240kHz instead of @160kHz and the waterfall shows +-120kHz instead of +-80kHz
+// the MIC comes back on PTT or when VOX is enabled
+// comment the line below to keep the original I Q MIC sampling all the time
+#define ADC_RX_IQ_ONLY
+extern volatile uint16_t adc_num_ch;   // ADC channels in the round robin: 3 = I Q MIC   2 = I Q
+extern volatile uint32_t fsamp_ch;     // sample freq of each channel = FSAMP / adc_num_ch
+extern volatile uint16_t fft_fres;     // Hz for each FFT bin = fsamp_ch / (fft_nsamp * fft_zoom)
+
+
+
+#define  FFT_REAL_HILBERT   11
+#define  FFT_COMPLEX_IQ     22
+// choose how the waterfall spectrum is calculated from the I and Q samples
+// FFT_REAL_HILBERT = Hilbert on Q, then two real FFTs: I-H(Q) for the upper band and I+H(Q) for the lower band
+// FFT_COMPLEX_IQ   = one complex FFT of I+jQ, upper band from the positive bins and lower band from the negative bins
+//#define FFT_METHOD  FFT_REAL_HILBERT
+#define FFT_METHOD  FFT_COMPLEX_IQ
 
 
 
@@ -74,12 +133,22 @@ void dsp_setagc(int agc);
 void dsp_setmode(int mode);
 void dsp_setvox(int vox);
 int dsp_getmode(void);
+int32_t dsp_sam_offset_hz(void);   // SAM: carrier freq locked by the PLL, from the tuned freq
+//NBFM: squelch on the noise above the voice, TX deviation limited by the MIC limiter
+#define FM_SQL_MAX          9
+#define FM_SQL_DEFAULT      5
+#define FM_DEV_MIN_HZ       1000
+#define FM_DEV_MAX_HZ       5000
+#define FM_DEV_DEFAULT_HZ   2500
+extern volatile uint16_t fm_squelch;   // 0 = open,  1 - 9
+extern volatile uint16_t fm_dev_hz;
+extern volatile int32_t fm_noise;      // squelch noise level (no signal = ~37000)
+void dsp_set_fm(uint16_t squelch, uint16_t dev_hz);
 
 //extern volatile uint16_t adc_audio_ready;
 extern volatile uint16_t tim_count;
 //extern volatile uint16_t fft_samples_ready;
 //extern volatile uint16_t fft_samp_pos;    //number of samples saved for FFT
-extern volatile uint16_t fft_samples_ready;
 extern volatile uint16_t fft_display_graf_new;
 
 #define AUD_GRAPH_NUM_COLS  100
@@ -105,8 +174,39 @@ extern volatile int32_t peak_avg_shifted;     // signal level detector after AGC
 #define AGC_GAIN_SHIFT  6        //shift corresponding to AGC_GAIN_MAX
 #define AGC_GAIN_MAX    (1u<<AGC_GAIN_SHIFT)       //max attenuation agc can do   signal * agc_gain / AGC_GAIN_MAX
 extern volatile uint16_t agc_gain;
-#define FFT_GAIN_SHIFT   4  //gain = 1 to 16 / 16
-extern volatile uint16_t fft_gain;
+#define RX_GAIN_SHIFT   4  //gain = 1 to 16 / 16
+extern volatile uint16_t rx_gain;   //RX audio gain (Enter + encoder), the waterfall has its own auto range
+extern volatile int16_t fft_bfp_shift;   //block floating point: FFT input samples << shift  (biggest one with no overflow)
+
+#define WF_FLOOR_DB   6    //waterfall level 0 (black) at this FFT bin level (6dB = old MAG>1 threshold)
+#define WF_SPAN_DB    60   //waterfall level 255 at floor + span
+void dsp_set_wf_range(uint16_t floor_db, uint16_t span_db);   //fixed range, auto range off
+void dsp_set_wf_auto(void);     //floor and span follow the noise floor and the peak (default)
+extern volatile bool wf_auto;
+
+//spectrum averaging of the FFT bin power (waterfall and panadapter), the noise gets smooth and weak signals show up with no more gain
+#define SPEC_AVG_OFF     0    //each FFT as it is
+#define SPEC_AVG_EXP     1    //exponential average, avg += (pow - avg) / 2^k
+#define SPEC_AVG_LIN     2    //mean of 2^k FFTs, one line each 2^k FFTs
+#define SPEC_AVG_NUM     3
+#define SPEC_AVG_K_MAX   3    //linear: 8 FFTs max (32 bits sum)
+#define SPEC_AVG_DEFAULT          SPEC_AVG_EXP
+#define SPEC_AVG_K_DEFAULT        2
+#define SPEC_PEAK_DECAY_MAX       8
+#define SPEC_PEAK_DECAY_DEFAULT   4    //peak hold falls 1/16 each FFT,  0 = no peak hold
+extern volatile uint16_t spec_avg_mode;
+extern volatile uint16_t spec_avg_k;
+extern volatile uint16_t spec_peak_decay;
+void dsp_set_spec_avg(uint16_t mode, uint16_t k, uint16_t peak_decay);
+
+#define FFT_WINDOW_RECT              0
+#define FFT_WINDOW_HANN              1
+#define FFT_WINDOW_BLACKMAN_HARRIS   2
+#define FFT_WINDOW_FLAT_TOP          3
+#define FFT_WINDOW_NUM               4
+extern volatile uint16_t fft_window_type;   // window in use
+extern volatile uint16_t fft_window_req;    // window asked, core1 changes it between two FFTs
+void dsp_set_fft_window(uint16_t win);
 
 extern volatile uint16_t dac_iq, dac_audio;
 extern volatile bool tx_enabled;
@@ -116,6 +216,15 @@ extern volatile bool tx_enabled;
 #define FIFO_FFT_READY  20
 #define FIFO_IQ_SAMPLE  30
 
+#define AUDIO_BLOCK_NSAMP   16u   // audio samples per FIFO IRQ to core0 (8 to 32),  latency = 2 x 16 / 16kHz = 2ms
+#define AUDIO_RING_NSAMP    64u   // size of the core1 <-> core0 audio rings, power of 2, >= 4 x AUDIO_BLOCK_NSAMP
+extern volatile uint32_t audio_overrun_count;
+extern volatile uint32_t audio_underrun_count;
+extern volatile uint32_t audio_out_overrun_count;
+extern volatile uint32_t audio_fifo_busy_count;
+extern volatile uint32_t dma_late_count;
+extern volatile uint32_t adc_overflow_count;
+
 
 void dsp_init();
 void dsp_loop();
@@ -113,7 +113,7 @@
  
 
 //char hmi_o_menu[HMI_NMENUS][8] = {"Tune","Mode","AGC","Pre","VOX"};	// Indexed by hmi_menu  not used - menus done direct in Evaluate()
-char hmi_o_mode[HMI_NUM_OPT_MODE][8] = {"USB","LSB","AM","CW"};			// Indexed by band_vars[hmi_band][HMI_S_MODE]  MODE_USB=0 MODE_LSB=1  MODE_AM=2  MODE_CW=3
+char hmi_o_mode[HMI_NUM_OPT_MODE][8] = {"USB","LSB","AM","CW","SAM","SAM-U","SAM-L","FM"};			// Indexed by band_vars[hmi_band][HMI_S_MODE]  MODE_USB=0 MODE_LSB=1  MODE_AM=2  MODE_CW=3  MODE_SAM=4..6  MODE_FM=7
 char hmi_o_agc [HMI_NUM_OPT_AGC][8] = {"NoAGC","Slow","Fast"};					// Indexed by band_vars[hmi_band][HMI_S_AGC]
 char hmi_o_pre [HMI_NUM_OPT_PRE][8] = {"-30dB","-20dB","-10dB","0dB","+10dB"};	// Indexed by band_vars[hmi_band][HMI_S_PRE]
 char hmi_o_vox [HMI_NUM_OPT_VOX][8] = {"NoVOX","VOX-L","VOX-M","VOX-H"};		// Indexed by band_vars[hmi_band][HMI_S_VOX]
@@ -154,7 +154,8 @@ uint8_t  band_vars[HMI_NUM_OPT_BPF][BAND_VARS_SIZE] =  { {4,0,2,3,0,0,0, b0_0, b
 
 
 uint32_t hmi_freq;														// Frequency from Tune state
-uint32_t hmi_step[HMI_NUM_OPT_TUNE] = {10000000, 1000000, 100000, 10000, 1000, 100, 50};	// Frequency digit increments (tune option = cursor position)
+uint32_t hmi_lo_freq = 0;												// Si5351 freq, hmi_freq - dsp_tune_hz
+uint32_t hmi_step[HMI_NUM_OPT_TUNE] = {10000000, 1000000, 100000, 10000, 1000, 100, 50, 0, 0};	// Frequency digit increments (tune option = cursor position), pan and snap steps from the waterfall
 //#define HMI_MAXFREQ		30000000
 //#define HMI_MINFREQ		     100
 const uint32_t hmi_maxfreq[HMI_NUM_OPT_BPF] = {2500000, 6000000, 12000000, 24000000, 40000000};	// max freq for each band from pass band filters
@@ -200,6 +201,62 @@ void Store_Last_Band(uint8_t band)
 }
 
 
+//***********************************************************************
+//
+// tune to hmi_freq:  small steps by the DSP mixers (no I2C, no click on the Si5351)
+// the Si5351 moves when the offset goes over DSP_TUNE_MAX_HZ (+-DSP_PAN_MAX_HZ = 64kHz on pan tuning, the limit of dsp_set_tune), or always with retune
+// 
+//***********************************************************************
+void hmi_tune(bool retune)
+{
+  int32_t offset = (int32_t)(hmi_freq - hmi_lo_freq);
+  int32_t max_hz = (band_vars[hmi_band][HMI_S_TUNE] >= HMI_TUNE_PAN) ? DSP_PAN_MAX_HZ : DSP_TUNE_MAX_HZ;
+
+  if(retune || (offset > max_hz) || (offset < -max_hz))
+  {
+    hmi_lo_freq = hmi_freq;
+    SI_SETFREQ(0, HMI_MULFREQ*hmi_lo_freq);
+    offset = 0;
+  }
+  dsp_set_tune(offset);
+}
+
+
+//***********************************************************************
+//
+// pan tuning: RX moved one waterfall column, or to the next signal (peak snap)
+// the Si5351 stays, the triangle moves on the waterfall
+// 
+//***********************************************************************
+void hmi_pan_step(int16_t dir)
+{
+  uint32_t f;
+
+  if(band_vars[hmi_band][HMI_S_TUNE] == HMI_TUNE_SNAP)
+  {
+    f = display_peak_snap(hmi_freq, dir);
+    if(f == 0)    //no signal on that side
+    {
+      return;
+    }
+  }
+  else
+  {
+    f = hmi_freq + (int32_t)dir * (int32_t)(fsamp_ch / ((uint32_t)fft_zoom * GRAPH_NUM_COLS));
+  }
+  if((f > hmi_minfreq[band_vars[hmi_band][HMI_S_BPF]]) && (f < hmi_maxfreq[band_vars[hmi_band][HMI_S_BPF]]))   // Boundary check
+  {
+    hmi_freq = f;
+  }
+}
+
+//cursor under the selected digit,  cyan on pan tuning (after the digits, the cursor is on the waterfall)
+void hmi_tune_cursor(uint8_t pos)
+{
+  tft_cursor_plus(3, (pos >= HMI_TUNE_PAN) ? TFT_CYAN : TFT_YELLOW, 2+(pos>4?6:pos), 0, 2, 20);
+}
+
+
 //***********************************************************************
 //
 // get band info from band_vars -> and set  freq
@@ -250,7 +307,7 @@ void Setup_Band(uint8_t band)
 
   //set the new band to display and freq
 
-	SI_SETFREQ(0, HMI_MULFREQ*hmi_freq);			// Set freq to hmi_freq (MULFREQ depends on mixer type)
+	hmi_tune(true);									// Set freq to hmi_freq (MULFREQ depends on mixer type)
 	SI_SETPHASE(0, 1);								// Set phase to 90deg (depends on mixer type)
 	
 	ptt_state = 0;
@@ -341,11 +398,15 @@ void hmi_handler(uint8_t event)
       //if(!gpio_get(GP_AUX_1_Escape))  //in case Escape is pressed
       if(!gpio_get(GP_AUX_0_Enter))  //in case Escape is pressed
       {
-        if(fft_gain<(1<<FFT_GAIN_SHIFT))
+        if(rx_gain<(1<<RX_GAIN_SHIFT))
           {
-            fft_gain++;
+            rx_gain++;
           }
       }
+      else if (hmi_menu_opt_display >= HMI_TUNE_PAN)
+      {
+        hmi_pan_step(1);
+      }
       else
       {
 			  if (hmi_freq < (hmi_maxfreq[band_vars[hmi_band][HMI_S_BPF]] - hmi_step[hmi_menu_opt_display]))		// Boundary check HMI_MAXFREQ
@@ -357,11 +418,15 @@ void hmi_handler(uint8_t event)
       //if(!gpio_get(GP_AUX_1_Escape))  //in case Escape is pressed
       if(!gpio_get(GP_AUX_0_Enter))  //in case Escape is pressed
       {
-        if(fft_gain>1)
+        if(rx_gain>1)
           {
-            fft_gain--;
+            rx_gain--;
           }
       }
+      else if (hmi_menu_opt_display >= HMI_TUNE_PAN)
+      {
+        hmi_pan_step(-1);
+      }
       else
       {
         if (hmi_freq > (hmi_step[hmi_menu_opt_display] + hmi_minfreq[band_vars[hmi_band][HMI_S_BPF]]))		// Boundary check HMI_MINFREQ
@@ -627,7 +692,7 @@ void hmi_evaluate(void)
   static uint8_t hmi_menu_old = 0xff;
   static uint8_t hmi_menu_opt_display_old = 0xff;
   static int16_t agc_gain_old = 1;
-  static int16_t fft_gain_old = 0;
+  static int16_t rx_gain_old = 0;
 
 #ifdef HMI_debug
   uint16_t ndata;
@@ -656,20 +721,20 @@ void hmi_evaluate(void)
 
   if(hmi_freq_old != hmi_freq)
   {
-    SI_SETFREQ(0, HMI_MULFREQ*hmi_freq);
+    hmi_tune(false);     //Si5351 only for big steps
     //freq  (from encoder)
     sprintf(s, "%7.1f", (double)hmi_freq/1000.0);
     tft_writexy_plus(3, TFT_YELLOW, TFT_BLACK, 2,0,2,20,(uint8_t *)s);
     //cursor (writing the freq erase the cursor)
 //    tft_cursor_plus(3, TFT_YELLOW, 2+(hmi_menu_opt_display>4?6:hmi_menu_opt_display), 0, 2, 20);
-    tft_cursor_plus(3, TFT_YELLOW, 2+(band_vars[hmi_band][HMI_S_TUNE]>4?6:band_vars[hmi_band][HMI_S_TUNE]), 0, 2, 20);
+    hmi_tune_cursor(band_vars[hmi_band][HMI_S_TUNE]);
     display_fft_graf_top();  //scale freqs
     hmi_freq_old = hmi_freq;
   }
   if(band_vars_old[HMI_S_MODE] != band_vars[hmi_band][HMI_S_MODE])    //mode (SSB AM CW)
   {
     dsp_setmode(band_vars[hmi_band][HMI_S_MODE]);  //MODE_USB=0 MODE_LSB=1  MODE_AM=2  MODE_CW=3
-    sprintf(s, "%s  ", hmi_o_mode[band_vars[hmi_band][HMI_S_MODE]]);
+    sprintf(s, "%-5s", hmi_o_mode[band_vars[hmi_band][HMI_S_MODE]]);
     tft_writexy_(2, TFT_GREEN, TFT_BLACK, 0,1,(uint8_t *)s);
     display_fft_graf_top();  //scale freqs, mode changes the triangle
     band_vars_old[HMI_S_MODE] = band_vars[hmi_band][HMI_S_MODE];
@@ -727,6 +792,10 @@ void hmi_evaluate(void)
   {
     if(tx_enabled == true)
     {
+      if(tx_tune_mute)    //pan tuned far from the Si5351: TX muted until it moves to the tuned freq
+      {
+        hmi_tune(true);
+      }
       sprintf(s, "T   ");
       tft_writexy_(2, TFT_RED, TFT_BLACK, 0,2,(uint8_t *)s);
     }
@@ -756,12 +825,12 @@ void hmi_evaluate(void)
       agc_gain_old = agc_gain;
     }
     
-    if(fft_gain_old != fft_gain)
+    if(rx_gain_old != rx_gain)
     {
-      sprintf(s, "%d  ",fft_gain);
+      sprintf(s, "%d  ",rx_gain);
       s[3]=0;
       tft_writexy_plus(1, TFT_GREEN, TFT_BLACK, 5, 9, 3, 5, (uint8_t *)s);   
-      fft_gain_old = fft_gain;
+      rx_gain_old = rx_gain;
     }       
   }
 
@@ -780,10 +849,11 @@ void hmi_evaluate(void)
   	switch (hmi_menu)
   	{
   	case HMI_S_TUNE:
-  		sprintf(s, "%s   %s   %s", hmi_o_vox[band_vars[hmi_band][HMI_S_VOX]], hmi_o_agc[band_vars[hmi_band][HMI_S_AGC]], hmi_o_pre[band_vars[hmi_band][HMI_S_PRE]]);
+  		sprintf(s, "%s   %s   %s   %s", hmi_o_vox[band_vars[hmi_band][HMI_S_VOX]], hmi_o_agc[band_vars[hmi_band][HMI_S_AGC]], hmi_o_pre[band_vars[hmi_band][HMI_S_PRE]],
+              (hmi_menu_opt_display == HMI_TUNE_PAN) ? "PAN " : ((hmi_menu_opt_display == HMI_TUNE_SNAP) ? "SNAP" : "    "));
       tft_writexy_(1, TFT_BLUE, TFT_BLACK,0,0,(uint8_t *)s);  
       //cursor
-      tft_cursor_plus(3, TFT_YELLOW, 2+(hmi_menu_opt_display>4?6:hmi_menu_opt_display), 0, 2, 20);    
+      hmi_tune_cursor(hmi_menu_opt_display);    
   		break;
   	case HMI_S_MODE:
   		sprintf(s, "Set Mode: %s        ", hmi_o_mode[hmi_menu_opt_display]);
@@ -825,11 +895,14 @@ void hmi_evaluate(void)
     if (fft_display_graf_new == 1)    //design a new graphic only when a new line is ready from FFT
     {
       //plot waterfall graphic     
-      display_fft_graf();  // warefall 110ms
-
-      fft_display_graf_new = 0;  
-      fft_samples_ready = 2;  //ready to start new sample collect
+      display_fft_graf();  // warefall 110ms with WF_DRAW_PIXEL, one burst per line with WF_DRAW_LINE   (it takes the line = fft_display_graf_new = 0)
     }
+#if PAN_NUM_LINES > 0
+    if (pan_trace_new == 1)    //new panadapter trace from FFT
+    {
+      display_pan_graf();
+    }
+#endif
   }
 
 
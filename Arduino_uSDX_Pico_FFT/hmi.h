@@ -42,8 +42,10 @@ extern "C" {
 //#define HMI_NEVENTS      9
 
 /* Sub menu option string sets */
-#define HMI_NUM_OPT_TUNE	7  // = num pos cursor
-#define HMI_NUM_OPT_MODE	4
+#define HMI_NUM_OPT_TUNE	9  // = num pos cursor
+#define HMI_TUNE_PAN		7  // cursor after the digits: encoder moves the RX one waterfall column, the Si5351 stays
+#define HMI_TUNE_SNAP		8  // encoder jumps to the next signal on the waterfall (peak snap), the Si5351 stays
+#define HMI_NUM_OPT_MODE	8
 #define HMI_NUM_OPT_AGC	3
 #define HMI_NUM_OPT_PRE	5
 #define HMI_NUM_OPT_VOX	4
@@ -51,11 +53,15 @@ extern "C" {
 #define HMI_NUM_OPT_DFLASH	2
 
 
-//"USB","LSB","AM","CW"
+//"USB","LSB","AM","CW","SAM","SAM-U","SAM-L","FM"
 #define MODE_USB  0
 #define MODE_LSB  1
 #define MODE_AM   2
 #define MODE_CW   3
+#define MODE_SAM  4   // synchronous AM, both sidebands
+#define MODE_SAMU 5   // synchronous AM, upper sideband
+#define MODE_SAML 6   // synchronous AM, lower sideband
+#define MODE_FM   7   // narrow band FM
 
 
 
@@ -108,6 +114,7 @@ extern "C" {
 
 //extern uint8_t  hmi_sub[HMI_NMENUS];							// Stored option selection per state
 extern uint32_t hmi_freq;  
+extern uint32_t hmi_lo_freq;   // Si5351 freq (hmi_freq - dsp_tune_hz)
 extern uint8_t  hmi_band;	
 extern bool ptt_active;
 
@@ -116,6 +123,7 @@ extern uint8_t  band_vars[HMI_NUM_OPT_BPF][BAND_VARS_SIZE];
 
 
 void Setup_Band(uint8_t band);
+void hmi_tune(bool retune);
 void hmi_init0(void);
 void hmi_init(void);
 void hmi_evaluate(void);
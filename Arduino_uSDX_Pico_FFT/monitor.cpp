@@ -36,6 +36,7 @@
 #include "dsp.h"
 #include "relay.h"
 #include "monitor.h"
+#include "display_tft.h"
 #include "uSDR.h"
 
 
@@ -175,17 +176,259 @@ void mon_rx(void)
 	
 }
 
+/*
+ * Waterfall intensity range and palette
+ */
+void mon_wf(void)
+{
+	if ((nargs>=2) && (*argv[1]=='a'))
+	{
+		dsp_set_wf_auto();
+		Serialx.print("auto range  fft input shift ");
+		Serialx.println((int)fft_bfp_shift);
+		return;
+	}
+	if (nargs>=3) 
+	{
+		dsp_set_wf_range((uint16_t)atoi(argv[1]), (uint16_t)atoi(argv[2]));
+		Serialx.print("floor ");
+		Serialx.print(atoi(argv[1]));
+		Serialx.print("dB  span ");
+		Serialx.print(atoi(argv[2]));
+		Serialx.println("dB");
+	}
+	if ((nargs>=4) && (atoi(argv[3]) < WF_PALETTE_NUM))
+	{
+		display_wf_palette((uint16_t)atoi(argv[3]));
+		Serialx.print("palette ");
+		Serialx.println(atoi(argv[3]));
+	}
+}
+
+
+
+/*
+ * FFT window type
+ */
+const char *fw_name[FFT_WINDOW_NUM] = {"rect", "Hann", "Blackman-Harris", "flat-top"};
+void mon_fw(void)
+{
+	if ((nargs>=2) && (atoi(argv[1]) < FFT_WINDOW_NUM))
+	{
+		dsp_set_fft_window((uint16_t)atoi(argv[1]));
+	}
+	Serialx.print("window ");
+	Serialx.println(fw_name[fft_window_req]);
+}
+
+
+
+/*
+ * FFT size 256, 512 or 1024 points (changed by core1 before the next FFT)
+ */
+void mon_fn(void)
+{
+	if (nargs>=2)
+	{
+		dsp_set_fft_size((uint16_t)atoi(argv[1]));
+	}
+	Serialx.print("fft ");
+	Serialx.print((unsigned int)fft_nsamp);
+	Serialx.print(" points  bin ");
+	Serialx.print((unsigned int)fft_fres);
+	Serialx.println(" Hz");
+}
+
+
+
+/*
+ * FFT overlap 0, 50 or 75% (hop between two FFTs on the sample ring)
+ */
+void mon_fo(void)
+{
+	if (nargs>=2)
+	{
+		dsp_set_fft_overlap((uint16_t)atoi(argv[1]));
+	}
+	Serialx.print("overlap ");
+	Serialx.print((unsigned int)fft_overlap);
+	Serialx.print("%  hop ");
+	Serialx.print((unsigned int)((fft_nsamp * (100u - fft_overlap)) / 100u));
+	Serialx.println(" samples");
+}
+
+
+
+/*
+ * Spectrum averaging and peak hold (waterfall and panadapter)
+ */
+const char *sa_name[SPEC_AVG_NUM] = {"off", "exponential", "linear"};
+void mon_sa(void)
+{
+	if (nargs>=3)
+	{
+		dsp_set_spec_avg((uint16_t)atoi(argv[1]), (uint16_t)atoi(argv[2]), (nargs>=4) ? (uint16_t)atoi(argv[3]) : spec_peak_decay);
+	}
+	Serialx.print("average ");
+	Serialx.print(sa_name[spec_avg_mode]);
+	Serialx.print("  k ");
+	Serialx.print((unsigned int)spec_avg_k);
+	Serialx.print("  peak decay ");
+	Serialx.println((unsigned int)spec_peak_decay);
+}
+
+
+
+/*
+ * Zoom FFT 1 2 4 8 16 around the tuned freq + offset (applied by core1 on the next block)
+ */
+void mon_zm(void)
+{
+	if (nargs>=2)
+	{
+		dsp_set_fft_zoom((uint16_t)atoi(argv[1]), (nargs>=3) ? (int32_t)atol(argv[2]) : 0);
+	}
+	Serialx.print("zoom ");
+	Serialx.print((unsigned int)fft_zoom);
+	Serialx.print("  offset ");
+	Serialx.print((long)fft_zoom_offset);
+	Serialx.print(" Hz  span ");
+	Serialx.print((unsigned long)(fsamp_ch / fft_zoom));
+	Serialx.print(" Hz  bin ");
+	Serialx.print((unsigned int)fft_fres);
+	Serialx.println(" Hz");
+}
+
+
+
+/*
+ * RIT and XIT by the DSP mixers, the Si5351 stays on its freq
+ */
+void mon_rt(void)
+{
+	if (nargs>=2)
+	{
+		dsp_set_rit((int32_t)atol(argv[1]));
+		if (nargs>=3)
+			dsp_set_xit((int32_t)atol(argv[2]));
+	}
+	Serialx.print("RIT ");
+	Serialx.print((long)rit_hz);
+	Serialx.print(" Hz  XIT ");
+	Serialx.print((long)xit_hz);
+	Serialx.print(" Hz  fine tune ");
+	Serialx.print((long)dsp_tune_hz);
+	Serialx.println(" Hz");
+}
+
+
+
+/*
+ * IF shift: RX mode filter passband moved by the DSP mixers
+ */
+void mon_is(void)
+{
+	if (nargs>=2)
+	{
+		dsp_set_if_shift((int32_t)atol(argv[1]));
+	}
+	Serialx.print("IF shift ");
+	Serialx.print((long)if_shift_hz);
+	Serialx.println(" Hz");
+}
+
+
+
+/*
+ * SAM carrier PLL
+ */
+void mon_sm(void)
+{
+	Serialx.print("SAM carrier ");
+	Serialx.print((long)dsp_sam_offset_hz());
+	Serialx.println(" Hz");
+}
+
+
+
+/*
+ * NBFM squelch level and TX deviation
+ */
+void mon_fm(void)
+{
+	if (nargs>=2)
+	{
+		dsp_set_fm((uint16_t)atoi(argv[1]), (nargs>=3) ? (uint16_t)atoi(argv[2]) : fm_dev_hz);
+	}
+	Serialx.print("FM squelch ");
+	Serialx.print((unsigned int)fm_squelch);
+	Serialx.print("  noise ");
+	Serialx.print((long)fm_noise);
+	Serialx.print("  deviation ");
+	Serialx.print((unsigned int)fm_dev_hz);
+	Serialx.println(" Hz");
+}
+
+
+
+/*
+ * Audio rings between core1 and core0, counters and reset
+ */
+void mon_iq(void)
+{
+	if ((nargs>=2) && (*argv[1]=='r'))
+	{
+		audio_overrun_count = 0;
+		audio_underrun_count = 0;
+		audio_out_overrun_count = 0;
+		audio_fifo_busy_count = 0;
+		dma_late_count = 0;
+		adc_overflow_count = 0;
+	}
+	Serialx.print("overrun ");
+	Serialx.print((unsigned long)audio_overrun_count);
+	Serialx.print("  underrun ");
+	Serialx.print((unsigned long)audio_underrun_count);
+	Serialx.print("  out overrun ");
+	Serialx.print((unsigned long)audio_out_overrun_count);
+	Serialx.print("  fifo busy ");
+	Serialx.println((unsigned long)audio_fifo_busy_count);
+	Serialx.print("dma late ");
+	Serialx.print((unsigned long)dma_late_count);
+	Serialx.print("  adc overflow ");
+	Serialx.println((unsigned long)adc_overflow_count);
+	Serialx.print("adc channels ");
+	Serialx.print((unsigned int)adc_num_ch);
+	Serialx.print("  fsamp ");
+	Serialx.print((unsigned long)fsamp_ch);
+	Serialx.print("  fft bin ");
+	Serialx.println((unsigned int)fft_fres);
+}
+
+
+
 /*
  * Command shell table, organize the command functions above
  */
-#define NCMD	6
+#define NCMD	16
 shell_t shell[NCMD]=
 {
 	{"si", 2, &mon_si, "si <start> <nr of reg>", "Dumps Si5351 registers"},
 	{"lt", 2, &mon_lt, "lt (no parameters)", "LCD test, dumps characterset on LCD"},
 	{"pt", 2, &mon_pt, "pt (no parameters)", "Toggles PTT status"},
 	{"bp", 2, &mon_bp, "bp {r|w} <value>", "Read or Write BPF relays"},
-	{"rx", 2, &mon_rx, "rx {r|w} <value>", "Read or Write RX relays"}
+	{"rx", 2, &mon_rx, "rx {r|w} <value>", "Read or Write RX relays"},
+	{"wf", 2, &mon_wf, "wf {a | <floor dB> <span dB> [palette]}", "Waterfall intensity auto range or fixed range, palette 0=gray 1=heat"},
+	{"fw", 2, &mon_fw, "fw <window>", "FFT window 0=rect 1=Hann 2=Blackman-Harris 3=flat-top"},
+	{"fn", 2, &mon_fn, "fn <points>", "FFT size 256, 512 or 1024"},
+	{"fo", 2, &mon_fo, "fo <overlap %>", "FFT overlap 0, 50 or 75"},
+	{"sa", 2, &mon_sa, "sa <mode> <k> [peak decay]", "Spectrum average 0=off 1=exp 1/2^k 2=mean of 2^k (k=1-3), peak decay 0=off"},
+	{"zm", 2, &mon_zm, "zm <zoom> [offset Hz]", "Zoom FFT 1, 2, 4, 8 or 16 around the tuned freq"},
+	{"rt", 2, &mon_rt, "rt <RIT Hz> [XIT Hz]", "RIT and XIT, +-3000 Hz, no Si5351 retune"},
+	{"is", 2, &mon_is, "is <shift Hz>", "IF shift of the RX filter passband, +-3000 Hz"},
+	{"sm", 2, &mon_sm, "sm (no parameters)", "SAM carrier offset locked by the PLL"},
+	{"fm", 2, &mon_fm, "fm <squelch> [deviation Hz]", "NBFM squelch 0=open 1-9, TX deviation 1000-5000 Hz"},
+	{"iq", 2, &mon_iq, "iq [r]", "Audio ring and ADC capture counters, r = reset"}
 };
 
 
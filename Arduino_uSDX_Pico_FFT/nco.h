@@ -0,0 +1,65 @@
+#ifndef __NCO_H__
+#define __NCO_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* 
+ * nco.h
+ *
+ * Created: Oct 2026
+ *
+ * See nco.cpp for more information 
+ */
+
+
+#define NCO_LUT_SIZE    256u        // sine table entries for one period
+#define NCO_LUT_SHIFT   24u         // 32 bits phase -> 8 bits table index
+#define NCO_COS_OFFSET  (NCO_LUT_SIZE/4u)
+
+extern const int16_t nco_sin_lut[NCO_LUT_SIZE];   // Q15
+
+typedef struct
+{
+  uint32_t phase;     // 2^32 = one period
+  uint32_t step;      // phase increment for each sample
+} nco_t;
+
+void nco_set_freq(nco_t *nco, int32_t freq_hz, uint32_t fsamp_hz);
+
+/* next cos and sin (Q15) of the oscillator */
+static inline void nco_next(nco_t *nco, int16_t *c, int16_t *s)
+{
+  uint32_t idx = nco->phase >> NCO_LUT_SHIFT;
+  *s = nco_sin_lut[idx];
+  *c = nco_sin_lut[(idx + NCO_COS_OFFSET) & (NCO_LUT_SIZE-1u)];
+  nco->phase += nco->step;
+}
+
+/* saturate to int16 */
+static inline int16_t nco_sat16(int32_t v)
+{
+  return (int16_t)((v > 32767) ? 32767 : ((v < -32768) ? -32768 : v));
+}
+
+/* complex mixer: (re + j*im) * e^(j*phase), the signal moves by +freq_hz
+ * any int16 input: the products sum fits in 32 bits (|table| <= 32767), the result is saturated
+ * (the rotation of a full scale I Q can be sqrt(2) bigger than int16)
+ */
+static inline void nco_mix(nco_t *nco, int16_t *re, int16_t *im)
+{
+  int16_t c, s;
+  int32_t x = *re;
+  int32_t y = *im;
+
+  nco_next(nco, &c, &s);
+  *re = nco_sat16((x * c - y * s) >> 15);
+  *im = nco_sat16((x * s + y * c) >> 15);
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif